@@ -0,0 +1,82 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+/* The parts of the Arduino core the firmware uses, for the host build.
+   See sim.h for how time and the inputs are simulated */
+#ifndef Arduino_h
+#define Arduino_h
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "avrstdio.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+enum { A0 = 14, A1, A2, A3, A4, A5 };
+
+#define PI 3.1415926535897932384626433832795
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+
+/* Functions rather than the core's macros, so the C++ library headers still compile */
+template <class T, class U> inline T min(T a, U b) { return (a < (T)b) ? a : (T)b; }
+template <class T, class U> inline T max(T a, U b) { return (a > (T)b) ? a : (T)b; }
+
+/* From avr-libc's stdlib.h */
+char* itoa(int value, char* s, int radix);
+char* ltoa(long value, char* s, int radix);
+char* ultoa(unsigned long value, char* s, int radix);
+
+#define interrupts() sei()
+#define noInterrupts() cli()
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+/* The output register and bit of a pin, as the AVR core's tables, for
+   AccelStepper::setFastOutputs(). The port is its register here */
+inline SimPort* digitalPinToPort(uint8_t pin) { return pin < 8 ? &PORTD : pin < 14 ? &PORTB : &PORTC; }
+inline SimPort* portOutputRegister(SimPort* port) { return port; }
+inline uint8_t digitalPinToBitMask(uint8_t pin) { return _BV((pin < 8 ? pin : pin < 14 ? pin - 8 : pin - 14) & 7); }
+
+#include "HardwareSerial.h"
+
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,31 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+/* EEPROM for the host build, 1K as the ATmega328P. See simEeprom in sim.h */
+#ifndef EEPROM_h
+#define EEPROM_h
+#include <stdint.h>
+
+class EEPROMClass {
+public:
+	uint8_t read(int address);
+	void write(int address, uint8_t value);
+};
+extern EEPROMClass EEPROM;
+
+#endif
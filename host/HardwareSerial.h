@@ -0,0 +1,50 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+/* Serial for the host build. Bytes written go out at the baud rate through
+   a 64 byte buffer, and write() waits for room as the real one does */
+#ifndef SIM_HARDWARESERIAL_H
+#define SIM_HARDWARESERIAL_H
+#include "Print.h"
+
+#define SERIAL_BUFFER_SIZE 64
+
+class HardwareSerial : public Print {
+public:
+	HardwareSerial();
+	void begin(unsigned long baud);
+	void end() {}
+	int available();
+	int peek();
+	int read();
+	int availableForWrite();
+	void flush();
+	virtual size_t write(uint8_t c);
+	using Print::write;
+	operator bool() { return true; }
+
+private:
+	/* Bytes waiting to go, not counting the one going out now */
+	int queued();
+
+	uint64_t m_byteTime;	/* CPU cycles */
+	uint64_t m_txDone;	/* When the last byte buffered has gone out */
+};
+extern HardwareSerial Serial;
+
+#endif
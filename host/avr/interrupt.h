@@ -0,0 +1,40 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+/* Interrupts for the host build. ISR() registers the handler with the
+   simulation, which calls it when its flag and enable bits are set */
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+#include <avr/io.h>
+
+#define cli() (SREG &= (uint8_t)~_BV(SREG_I))
+#define sei() (SREG |= _BV(SREG_I))
+
+typedef void (*SimHandler)(void);
+void simSetVector(uint8_t vector, SimHandler handler);
+
+struct SimVector {
+	SimVector(uint8_t vector, SimHandler handler) { simSetVector(vector, handler); }
+};
+
+#define ISR(vector) \
+	static void vector##_handler(void); \
+	static SimVector vector##_entry(vector##_num, vector##_handler); \
+	static void vector##_handler(void)
+
+#endif
@@ -0,0 +1,135 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+/* The ATmega328P registers the firmware uses, for the host build.
+   Only Timer1 in normal mode, and the ADC when free running or
+   triggered by Timer0 overflow, are simulated, see hal.cpp */
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+/* SREG. Setting the I bit takes any interrupts that are pending */
+class SimSREG {
+public:
+	operator uint8_t() const { return m_value; }
+	SimSREG& operator=(uint8_t value);
+	SimSREG& operator|=(uint8_t value) { return *this = m_value | value; }
+	SimSREG& operator&=(uint8_t value) { return *this = m_value & value; }
+private:
+	uint8_t m_value;
+};
+extern SimSREG SREG;
+#define SREG_I 7
+
+/* Interrupt flag register. Writing a 1 to a flag clears it */
+class SimFlags {
+public:
+	operator uint8_t() const { return m_value; }
+	SimFlags& operator=(uint8_t value) { m_value &= ~value; return *this; }
+	SimFlags& operator|=(uint8_t value) { m_value &= ~value; return *this; }
+	void raise(uint8_t bit) { m_value |= _BV(bit); }
+private:
+	uint8_t m_value;
+};
+
+/* Output ports. Writes change the pins as digitalWrite() does, at no cost */
+class SimPort {
+public:
+	SimPort(uint8_t firstPin) : m_firstPin(firstPin), m_value(0) {}
+	operator uint8_t() const { return m_value; }
+	SimPort& operator=(uint8_t value);
+	SimPort& operator|=(uint8_t value) { return *this = m_value | value; }
+	SimPort& operator&=(uint8_t value) { return *this = m_value & value; }
+	/* For digitalWrite() */
+	void setBit(uint8_t bit, uint8_t level) { m_value = level ? (m_value | _BV(bit)) : (m_value & ~_BV(bit)); }
+private:
+	uint8_t m_firstPin;	/* Arduino pin number of bit 0 */
+	uint8_t m_value;
+};
+extern SimPort PORTB;
+extern SimPort PORTC;
+extern SimPort PORTD;
+
+/* Timer1. The counter is worked out from the virtual clock */
+extern volatile uint8_t  TCCR1A;
+extern volatile uint8_t  TCCR1B;
+extern volatile uint8_t  TIMSK1;
+extern SimFlags          TIFR1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t OCR1B;
+uint16_t simTCNT1();
+#define TCNT1 (simTCNT1())
+
+#define CS10   0
+#define CS11   1
+#define CS12   2
+#define WGM12  3
+#define WGM13  4
+#define TOIE1  0
+#define OCIE1A 1
+#define OCIE1B 2
+#define TOV1   0
+#define OCF1A  1
+#define OCF1B  2
+
+/* ADC control and status A. Writing a 1 to ADIF clears it, the
+   other bits are as written */
+class SimADCSRA {
+public:
+	operator uint8_t() const { return m_value; }
+	SimADCSRA& operator=(uint8_t value) { m_value = (value & ~_BV(4)) | (m_value & ~value & _BV(4)); return *this; }
+	SimADCSRA& operator|=(uint8_t value) { return *this = m_value | value; }
+	SimADCSRA& operator&=(uint8_t value) { return *this = m_value & value; }
+	void raise() { m_value |= _BV(4); }
+private:
+	uint8_t m_value;
+};
+
+/* ADC. Conversions read the value set by simSetAnalog() */
+extern volatile uint8_t  ADMUX;
+extern SimADCSRA         ADCSRA;
+extern volatile uint8_t  ADCSRB;
+extern volatile uint8_t  DIDR0;
+extern volatile uint16_t ADC;
+
+#define MUX0   0
+#define ADLAR  5
+#define REFS0  6
+#define REFS1  7
+#define ADPS0  0
+#define ADPS1  1
+#define ADPS2  2
+#define ADIE   3
+#define ADIF   4
+#define ADATE  5
+#define ADSC   6
+#define ADEN   7
+#define ADTS0  0
+#define ADTS1  1
+#define ADTS2  2
+
+/* Interrupt vector numbers, as avr-libc */
+#define TIMER1_COMPA_vect_num 11
+#define TIMER1_COMPB_vect_num 12
+#define TIMER1_OVF_vect_num   13
+#define ADC_vect_num          21
+#define SIM_VECTORS           26
+
+#endif
@@ -0,0 +1,40 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+/* avr-libc's user supplied stdio streams, for the host build.
+   fprintf() to a stream set up with fdev_setup_stream() formats into a
+   buffer and hands each char to the put function, anything else goes to
+   the C library as usual */
+#ifndef SIM_AVRSTDIO_H
+#define SIM_AVRSTDIO_H
+#include <stdio.h>
+
+#define _FDEV_SETUP_READ  1
+#define _FDEV_SETUP_WRITE 2
+#define _FDEV_SETUP_RW    3
+
+typedef int (*SimPut)(char c, FILE* stream);
+typedef int (*SimGet)(FILE* stream);
+
+void simSetupStream(FILE* stream, SimPut put, SimGet get, int flags);
+int simFprintf(FILE* stream, const char* format, ...);
+
+#define fdev_setup_stream(stream, put, get, flags) simSetupStream(stream, put, get, flags)
+#define fprintf simFprintf
+
+#endif
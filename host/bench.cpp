@@ -0,0 +1,456 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+/* Step timing benchmarks for AccelStepper on the simulated Arduino.
+
+   stepbench [-j] [-s steps.csv] [-d mm] [-c mode,load,steps/mm,mm/s,mm/s2]...
+   stepbench [-j] -p
+
+   Each case moves the weld motor, set up as main.cpp does, and records the
+   time of every STEP rising edge. The step times are compared with the ideal
+   profile: constant speed, or a trapezoid at the set acceleration.
+
+   Modes:
+	runSpeed	polled runSpeed(), constant speed
+	run		polled run(), accelerating, so computeNewSpeed() each step
+	timer		StepTimer at constant speed, as main.cpp runs a weld
+	timerAccel	StepTimer accelerating
+   Loads, done between polls in place of the rest of loop():
+	none		nothing
+	keypad		KEY.read(), an analogRead() every pass
+	lcd		KEY.read() and an UpdateLCD() of both lines every pass,
+			as in MNU_RUN_COUNTDOWN
+
+   For each case it reports:
+	speed_err_pct	mean speed against the set speed, over the constant speed part
+	time_err_pct	time for the whole move against the ideal profile
+	jitter_p50_us, jitter_p99_us, jitter_max_us
+			each step interval against the ideal interval
+	ramp_err_ms	worst step time against the ideal profile, from the first step
+	missed		missed deadlines, from StepTimer or AccelStepper
+
+   Without -c a standard set of cases is run. Results are CSV, or JSON with -j.
+   -s writes every step time, in microseconds from the first step, to a file
+
+   -p measures what each step costs instead, taking the steps of a move back
+   to back with timerStep(), for:
+	equation13	accelerating with Equation 13 in floating point
+	rampTable	accelerating with setRampTable(), integer maths only
+	digitalWrite	the DRIVER outputs of main.cpp at constant speed
+	fastOutputs	the same with setFastOutputs(), port registers
+	staticStepper	the same with StaticStepper, as main.cpp has it
+   It reports:
+	host_ns_per_step	real time on this machine, the best of several
+				runs. Floating point is in hardware here, where
+				the Uno does it in software, so this understates
+				what the ramp table saves there. The outputs'
+				time here is mostly the simulator's
+	sim_us_per_step		virtual time on the simulated Uno, which is only
+				the Arduino calls, as costed in sim.h, including
+				the 1us pulse width. Port register writes cost
+				nothing there, and a few cycles on the Uno
+   The sketches in libs/AccelStepper/examples time the same on the board */
+#include <vector>
+#include <algorithm>
+#include <time.h>
+#include "Arduino.h"
+#include "LiquidCrystal.h"
+#include <AccelStepper.h>
+#include <StaticStepper.h>
+#include <StepTimer.h>
+#include "sim.h"
+
+/* As main.cpp */
+enum { pKEY = 0, pSTEP = A4, pDIR = A5 };
+
+enum { MODE_RUNSPEED, MODE_RUN, MODE_TIMER, MODE_TIMER_ACCEL, MODE_LAST };
+static const char* modes[] = { "runSpeed", "run", "timer", "timerAccel" };
+
+enum { LOAD_NONE, LOAD_KEYPAD, LOAD_LCD, LOAD_LAST };
+static const char* loads[] = { "none", "keypad", "lcd" };
+
+struct Case {
+	int   mode;
+	int   load;
+	float stepsPerMm;
+	float speed;	/* mm/s */
+	float accel;	/* mm/s^2 */
+};
+
+struct Result {
+	long   steps;
+	double speedErr;
+	double timeErr;
+	double jitter50;
+	double jitter99;
+	double jitterMax;
+	double rampErr;
+	unsigned long missed;
+};
+
+enum { COST_EQUATION13, COST_RAMP_TABLE, COST_DIGITAL_WRITE, COST_FAST_OUTPUTS,
+       COST_STATIC_STEPPER, COST_LAST };
+static const char* costs[] = { "equation13", "rampTable", "digitalWrite", "fastOutputs",
+			       "staticStepper" };
+
+#define COST_RUNS 200
+
+struct Cost {
+	long   steps;
+	double hostNs;
+	double simUs;
+};
+
+static LiquidCrystal lcd(8, 13, 9, 4, 5, 6, 7);
+static std::vector<double> stepTimes;	/* us */
+
+static void pinHook(uint8_t pin, uint8_t value)
+{
+	if (pin == pSTEP && value)
+		stepTimes.push_back(simNanos() / 1000.0);
+}
+
+/* The rest of a pass of loop() */
+static void load(int which)
+{
+	simAdvance(simCost.loop);
+	if (which == LOAD_NONE)
+		return;
+	analogRead(pKEY);
+	if (which == LOAD_LCD)
+	{
+		for (uint8_t row = 0; row < 2; row++)
+		{
+			lcd.setCursor(0, row);
+			for (uint8_t i = 0; i < 16; i++)
+				lcd.write(' ');
+		}
+	}
+}
+
+/* Ideal time of step k, 0 based, in us from the first. The move is
+   distance steps, and so one fewer intervals. accel 0 is constant speed */
+static double idealTime(long k, long distance, double speed, double accel)
+{
+	double d = distance - 1;
+	if (accel <= 0.0)
+		return k / speed * 1e6;
+	double pa = min(speed * speed / (2.0 * accel), d / 2.0);
+	double ta = sqrt(2.0 * pa / accel);
+	double peak = accel * ta;
+	double total = 2.0 * ta + (d - 2.0 * pa) / peak;
+	if (k <= pa)
+		return sqrt(2.0 * k / accel) * 1e6;
+	if (k < d - pa)
+		return (ta + (k - pa) / peak) * 1e6;
+	return (total - sqrt(2.0 * (d - k) / accel)) * 1e6;
+}
+
+static double percentile(std::vector<double>& v, double p)
+{
+	if (v.empty())
+		return 0.0;
+	size_t i = (size_t)(p * (v.size() - 1) + 0.5);
+	std::nth_element(v.begin(), v.begin() + i, v.end());
+	return v[i];
+}
+
+static Result runCase(const Case& c, float distance)
+{
+	StaticStepper<AccelStepper::DRIVER, pSTEP, pDIR> stepper;
+	Result r;
+	long steps = (long)(c.stepsPerMm * distance);
+	double speed = c.stepsPerMm * c.speed;
+	double accel = (c.mode == MODE_RUN || c.mode == MODE_TIMER_ACCEL) ?
+		c.stepsPerMm * c.accel : 0.0;
+
+	stepper.setNonBlockingPulse(true);
+	stepper.setDirectionSetupTime(5);
+	stepper.setMaxSpeed(speed);
+	if (accel > 0.0)
+		stepper.setAcceleration(accel);
+	stepper.setCurrentPosition(0);
+	stepper.moveTo(steps);
+	if (accel <= 0.0)
+		stepper.setSpeed(speed);
+	stepper.resetTimingStats();
+	StepTimer::resetStats();
+	stepTimes.clear();
+
+	switch (c.mode)
+	{
+		case MODE_RUNSPEED:
+			while (stepper.distanceToGo())
+			{
+				stepper.runSpeed();
+				load(c.load);
+			}
+			break;
+		case MODE_RUN:
+			while (stepper.run())
+				load(c.load);
+			break;
+		case MODE_TIMER:
+		case MODE_TIMER_ACCEL:
+			StepTimer::begin(&stepper, c.mode == MODE_TIMER_ACCEL);
+			while (StepTimer::running())
+				load(c.load);
+			break;
+	}
+	r.missed = (c.mode == MODE_TIMER || c.mode == MODE_TIMER_ACCEL) ?
+		StepTimer::missedDeadlines() : stepper.missedDeadlines();
+	r.steps = stepTimes.size();
+	r.speedErr = r.timeErr = r.jitter50 = r.jitter99 = r.jitterMax = r.rampErr = 0.0;
+	if (r.steps < 2)
+		return r;
+
+	double first = stepTimes[0];
+	for (size_t k = 0; k < stepTimes.size(); k++)
+		stepTimes[k] -= first;
+
+	// The constant speed part, or all of it at constant speed
+	long from = 0, to = r.steps - 1;
+	if (accel > 0.0)
+	{
+		double pa = speed * speed / (2.0 * accel);
+		from = (long)ceil(pa);
+		to = (long)floor(steps - 1 - pa);
+	}
+	if (to > from)
+	{
+		double measured = (to - from) / (stepTimes[to] - stepTimes[from]) * 1e6;
+		r.speedErr = (measured - speed) / speed * 100.0;
+	}
+	double ideal = idealTime(steps - 1, steps, speed, accel);
+	r.timeErr = (stepTimes[r.steps - 1] - ideal) / ideal * 100.0;
+
+	std::vector<double> jitter;
+	for (long k = 0; k < r.steps; k++)
+	{
+		double err = fabs(stepTimes[k] - idealTime(k, steps, speed, accel));
+		if (err > r.rampErr)
+			r.rampErr = err;
+		if (k)
+			jitter.push_back(fabs((stepTimes[k] - stepTimes[k - 1]) -
+				(idealTime(k, steps, speed, accel) - idealTime(k - 1, steps, speed, accel))));
+	}
+	r.rampErr /= 1000.0;
+	r.jitter50 = percentile(jitter, 0.50);
+	r.jitter99 = percentile(jitter, 0.99);
+	r.jitterMax = *std::max_element(jitter.begin(), jitter.end());
+	return r;
+}
+
+static void noStep()
+{
+}
+
+/* The steps of a move for -p, back to back. Returns how many */
+static long costMove(AccelStepper& stepper, int which)
+{
+	long steps = 0;
+
+	stepper.setCurrentPosition(0);
+	if (which >= COST_DIGITAL_WRITE)
+	{
+		// As examples/FastOutputs, so only the outputs differ
+		stepper.setFastOutputs(which == COST_FAST_OUTPUTS);
+		stepper.setMaxSpeed(1000);
+		stepper.moveTo(1000);
+		stepper.setSpeed(1000);
+		while (stepper.timerStep(false))
+			steps++;
+		return steps;
+	}
+	// As examples/RampTable, accelerating all the way up and back down
+	stepper.setRampTable(which == COST_RAMP_TABLE);
+	stepper.setMaxSpeed(100000);
+	stepper.setAcceleration(2000);
+	stepper.moveTo(4000);
+	while (stepper.timerStep(true))
+		steps++;
+	return steps;
+}
+
+static Cost runCost(int which)
+{
+	AccelStepper function(noStep, noStep);
+	AccelStepper driver(AccelStepper::DRIVER, pSTEP, pDIR);
+	StaticStepper<AccelStepper::DRIVER, pSTEP, pDIR> fixed;
+	AccelStepper& stepper = (which == COST_STATIC_STEPPER) ? fixed :
+		(which >= COST_DIGITAL_WRITE) ? driver : function;
+	Cost c = { 0, 0.0, 0.0 };
+
+	for (int run = 0; run < COST_RUNS; run++)
+	{
+		struct timespec start, end;
+		uint64_t sim = simNanos();
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		c.steps = costMove(stepper, which);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+		if (!run || ns < c.hostNs)
+			c.hostNs = ns;
+		c.simUs = (simNanos() - sim) / 1000.0;
+	}
+	c.hostNs /= c.steps;
+	c.simUs /= c.steps;
+	return c;
+}
+
+static void printCosts(bool json)
+{
+	if (json)
+		printf("[\n");
+	else
+		printf("case,steps,host_ns_per_step,sim_us_per_step\n");
+	for (int n = 0; n < COST_LAST; n++)
+	{
+		Cost c = runCost(n);
+		if (json)
+			printf("  {\"case\": \"%s\", \"steps\": %ld, \"host_ns_per_step\": %.1f, "
+			       "\"sim_us_per_step\": %.2f}%s\n",
+			       costs[n], c.steps, c.hostNs, c.simUs, n + 1 < COST_LAST ? "," : "");
+		else
+			printf("%s,%ld,%.1f,%.2f\n", costs[n], c.steps, c.hostNs, c.simUs);
+	}
+	if (json)
+		printf("]\n");
+}
+
+static bool parseCase(const char* arg, Case* c)
+{
+	char mode[16], load[16];
+	if (sscanf(arg, "%15[^,],%15[^,],%f,%f,%f", mode, load,
+		   &c->stepsPerMm, &c->speed, &c->accel) != 5)
+		return false;
+	for (c->mode = 0; c->mode < MODE_LAST && strcmp(mode, modes[c->mode]); c->mode++)
+		;
+	for (c->load = 0; c->load < LOAD_LAST && strcmp(load, loads[c->load]); c->load++)
+		;
+	return c->mode < MODE_LAST && c->load < LOAD_LAST && c->stepsPerMm > 0 && c->speed > 0;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: stepbench [-j] [-s steps.csv] [-d mm] [-c mode,load,steps/mm,mm/s,mm/s2]...\n"
+		"       stepbench [-j] -p\n");
+	exit(1);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<Case> cases;
+	bool json = false;
+	bool cost = false;
+	float distance = 10.0;
+	FILE* stepFile = NULL;
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-j"))
+			json = true;
+		else if (!strcmp(argv[i], "-p"))
+			cost = true;
+		else if (i + 1 == argc)
+			usage();
+		else if (!strcmp(argv[i], "-d"))
+			distance = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-s"))
+		{
+			if (!(stepFile = fopen(argv[++i], "w")))
+			{
+				perror(argv[i]);
+				return 1;
+			}
+			fprintf(stepFile, "case,step,time_us\n");
+		}
+		else if (!strcmp(argv[i], "-c"))
+		{
+			Case c;
+			if (!parseCase(argv[++i], &c))
+				usage();
+			cases.push_back(c);
+		}
+		else
+			usage();
+	}
+	if (distance <= 0.0 || (cost && (stepFile || !cases.empty())))
+		usage();
+	if (cost)
+	{
+		sei();
+		printCosts(json);
+		return 0;
+	}
+
+	if (cases.empty())
+	{
+		// The range of the welder's programs, with and without the loads of the UI
+		static const float stepsPerMm[] = { 100, 400 };
+		static const float speeds[] = { 1, 5, 20 };
+		for (int mode = 0; mode < MODE_LAST; mode++)
+			for (int load = 0; load < LOAD_LAST; load++)
+				for (int s = 0; s < 2; s++)
+					for (int v = 0; v < 3; v++)
+					{
+						Case c = { mode, load, stepsPerMm[s], speeds[v], 100 };
+						cases.push_back(c);
+					}
+	}
+
+	simPinHook = pinHook;
+	sei();
+	lcd.begin(16, 2);
+
+	if (json)
+		printf("[\n");
+	else
+		printf("mode,load,steps_mm,speed_mm_s,accel_mm_s2,steps,speed_err_pct,time_err_pct,"
+		       "jitter_p50_us,jitter_p99_us,jitter_max_us,ramp_err_ms,missed\n");
+	for (size_t n = 0; n < cases.size(); n++)
+	{
+		const Case& c = cases[n];
+		Result r = runCase(c, distance);
+		float accel = (c.mode == MODE_RUN || c.mode == MODE_TIMER_ACCEL) ? c.accel : 0;
+		if (json)
+			printf("  {\"mode\": \"%s\", \"load\": \"%s\", \"steps_mm\": %g, \"speed_mm_s\": %g, "
+			       "\"accel_mm_s2\": %g, \"steps\": %ld, \"speed_err_pct\": %.4f, "
+			       "\"time_err_pct\": %.4f, \"jitter_p50_us\": %.2f, \"jitter_p99_us\": %.2f, "
+			       "\"jitter_max_us\": %.2f, \"ramp_err_ms\": %.3f, \"missed\": %lu}%s\n",
+			       modes[c.mode], loads[c.load], c.stepsPerMm, c.speed, accel, r.steps,
+			       r.speedErr, r.timeErr, r.jitter50, r.jitter99, r.jitterMax, r.rampErr,
+			       r.missed, n + 1 < cases.size() ? "," : "");
+		else
+			printf("%s,%s,%g,%g,%g,%ld,%.4f,%.4f,%.2f,%.2f,%.2f,%.3f,%lu\n",
+			       modes[c.mode], loads[c.load], c.stepsPerMm, c.speed, accel, r.steps,
+			       r.speedErr, r.timeErr, r.jitter50, r.jitter99, r.jitterMax, r.rampErr,
+			       r.missed);
+		if (stepFile)
+		{
+			for (size_t k = 0; k < stepTimes.size(); k++)
+				fprintf(stepFile, "%u,%u,%.1f\n", (unsigned)n, (unsigned)k, stepTimes[k]);
+		}
+	}
+	if (json)
+		printf("]\n");
+	if (stepFile)
+		fclose(stepFile);
+	return 0;
+}
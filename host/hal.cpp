@@ -0,0 +1,719 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+/* The simulated Arduino for the host build: the virtual clock, Timer1
+   and interrupts, pins, Serial, the LCD and EEPROM */
+#include <stdarg.h>
+#include "Arduino.h"
+#include "LiquidCrystal.h"
+#include "EEPROM.h"
+#include "sim.h"
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+#define CYCLES_PER_US (F_CPU / 1000000UL)
+
+SimCosts simCost = {
+	10000,		/* loop */
+	4000,		/* micros */
+	2000,		/* millis */
+	4000,		/* digitalWrite */
+	112000,		/* analogRead, 13 ADC clocks at 125kHz */
+	300000,		/* lcdCommand, two nibbles each with a 100us settle */
+	2300000,	/* lcdClear, plus a 2ms wait */
+	20000,		/* format, vfprintf with floats is slow */
+	5000,		/* serialWrite */
+	1000,		/* eepromRead */
+	3400000,	/* eepromWrite, the cell erase and write time */
+	3000		/* isr */
+};
+
+void (*simSerialHook)(uint8_t c) = 0;
+void (*simPinHook)(uint8_t pin, uint8_t value) = 0;
+
+/* The clock, in CPU cycles since reset */
+static uint64_t s_cycles = 0;
+
+static uint64_t cycles(uint64_t ns)
+{
+	return ns * CYCLES_PER_US / 1000;
+}
+
+uint64_t simNanos()
+{
+	return s_cycles * 1000 / CYCLES_PER_US;
+}
+
+/* Interrupts */
+
+SimSREG SREG;
+volatile uint8_t  TCCR1A;
+volatile uint8_t  TCCR1B;
+volatile uint8_t  TIMSK1;
+SimFlags          TIFR1;
+volatile uint16_t OCR1A;
+volatile uint16_t OCR1B;
+
+static int s_analog[8] = { 1023, 1023, 1023, 1023, 1023, 1023 };
+volatile uint8_t  ADMUX;
+SimADCSRA         ADCSRA;
+volatile uint8_t  ADCSRB;
+volatile uint8_t  DIDR0;
+volatile uint16_t ADC;
+
+static SimHandler s_vectors[SIM_VECTORS];
+static bool s_inDispatch = false;
+
+void simSetVector(uint8_t vector, SimHandler handler)
+{
+	s_vectors[vector] = handler;
+}
+
+/* Takes pending interrupts in priority order, for as long as they are enabled.
+   As on the AVR, each handler runs with interrupts disabled and clears its own flag */
+static void dispatch()
+{
+	static const struct {
+		uint8_t vector;
+		uint8_t bit;	/* Same bit in TIFR1 and TIMSK1 */
+	} sources[] = {
+		{ TIMER1_COMPA_vect_num, OCF1A },
+		{ TIMER1_COMPB_vect_num, OCF1B },
+		{ TIMER1_OVF_vect_num,   TOV1 }
+	};
+
+	if (s_inDispatch)
+		return;
+	s_inDispatch = true;
+	while (SREG & _BV(SREG_I))
+	{
+		uint8_t i, vector;
+		for (i = 0; i < sizeof(sources) / sizeof(sources[0]); i++)
+		{
+			if ((TIFR1 & TIMSK1 & _BV(sources[i].bit)) &&
+			    s_vectors[sources[i].vector])
+				break;
+		}
+		if (i < sizeof(sources) / sizeof(sources[0]))
+		{
+			vector = sources[i].vector;
+			TIFR1 = _BV(sources[i].bit);
+		}
+		else if ((ADCSRA & _BV(ADIF)) && (ADCSRA & _BV(ADIE)) &&
+			 s_vectors[ADC_vect_num])
+		{
+			vector = ADC_vect_num;
+			ADCSRA = ADCSRA | _BV(ADIF);
+		}
+		else
+			break;
+		SREG = SREG & ~_BV(SREG_I);
+		simAdvance(simCost.isr);
+		s_vectors[vector]();
+		SREG = SREG | _BV(SREG_I);
+	}
+	s_inDispatch = false;
+}
+
+SimSREG& SimSREG::operator=(uint8_t value)
+{
+	m_value = value;
+	if (value & _BV(SREG_I))
+		dispatch();
+	return *this;
+}
+
+/* Timer1 cycles per count, or 0 if stopped or not in normal mode */
+static uint64_t timer1Prescale()
+{
+	static const uint16_t prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+	if ((TCCR1A & 3) || (TCCR1B & (_BV(WGM12) | _BV(WGM13))))
+		return 0;
+	return prescale[TCCR1B & 7];
+}
+
+uint16_t simTCNT1()
+{
+	uint64_t prescale = timer1Prescale();
+	return prescale ? (uint16_t)(s_cycles / prescale) : 0;
+}
+
+/* The cycle after now when the counter next reaches value */
+static uint64_t timer1Match(uint64_t prescale, uint16_t value)
+{
+	uint64_t count = s_cycles / prescale;
+	uint32_t ahead = (uint16_t)(value - (uint16_t)count);
+	if (!ahead)
+		ahead = 0x10000;
+	return (count + ahead) * prescale;
+}
+
+/* The cycle after now when the ADC next finishes a conversion by itself,
+   or 0 if it doesn't. It can free run, or be started by Timer0 overflowing,
+   which the Arduino core has count every 1024us */
+static uint64_t adcComplete()
+{
+	uint64_t prescale = 2 << ((ADCSRA & 7) ? (ADCSRA & 7) - 1 : 0);
+	uint64_t period, convert;
+	if ((ADCSRA & (_BV(ADEN) | _BV(ADATE))) != (_BV(ADEN) | _BV(ADATE)))
+		return 0;
+	if ((ADCSRB & 7) == 0)
+	{
+		period = 13 * prescale;
+		convert = 0;
+	}
+	else if ((ADCSRB & 7) == _BV(ADTS2))
+	{
+		period = 64 * 256;
+		convert = 27 * prescale / 2;
+	}
+	else
+		return 0;
+	if (s_cycles < convert)
+		return convert;
+	return ((s_cycles - convert) / period + 1) * period + convert;
+}
+
+void simAdvance(uint64_t ns)
+{
+	uint64_t target = s_cycles + cycles(ns);
+	for (;;)
+	{
+		// Timer1 and ADC events up to the target, in time order. The
+		// flags are set at the exact cycle, and any handlers taken
+		// straight away
+		uint64_t prescale = timer1Prescale();
+		uint64_t a = UINT64_MAX, b = UINT64_MAX, overflow = UINT64_MAX;
+		uint64_t adc = adcComplete();
+		if (prescale)
+		{
+			a = timer1Match(prescale, OCR1A);
+			b = timer1Match(prescale, OCR1B);
+			overflow = timer1Match(prescale, 0);
+		}
+		if (!adc)
+			adc = UINT64_MAX;
+		uint64_t next = min(min(a, b), min(overflow, adc));
+		if (next > target)
+			break;
+		s_cycles = next;
+		if (next == a)
+			TIFR1.raise(OCF1A);
+		if (next == b)
+			TIFR1.raise(OCF1B);
+		if (next == overflow)
+			TIFR1.raise(TOV1);
+		if (next == adc)
+		{
+			ADC = s_analog[ADMUX & 7];
+			ADCSRA.raise();
+		}
+		dispatch();
+	}
+	// A handler may have taken us past the target already
+	if (s_cycles < target)
+		s_cycles = target;
+}
+
+/* Time */
+
+unsigned long micros()
+{
+	simAdvance(simCost.micros);
+	return s_cycles / CYCLES_PER_US;
+}
+
+unsigned long millis()
+{
+	simAdvance(simCost.millis);
+	return s_cycles / (CYCLES_PER_US * 1000);
+}
+
+void delay(unsigned long ms)
+{
+	simAdvance((uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	simAdvance((uint64_t)us * 1000);
+}
+
+/* Pins */
+
+#define SIM_PINS 20
+static uint8_t s_pins[SIM_PINS];
+static unsigned long s_rising[SIM_PINS];
+
+SimPort PORTB(8);
+SimPort PORTC(14);
+SimPort PORTD(0);
+
+static void setPin(uint8_t pin, uint8_t value)
+{
+	if (pin >= SIM_PINS || s_pins[pin] == value)
+		return;
+	s_pins[pin] = value;
+	if (value)
+		s_rising[pin]++;
+	if (simPinHook)
+		simPinHook(pin, value);
+}
+
+SimPort& SimPort::operator=(uint8_t value)
+{
+	uint8_t changed = m_value ^ value;
+	m_value = value;
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		if (changed & _BV(i))
+			setPin(m_firstPin + i, (value >> i) & 1);
+	}
+	return *this;
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+	simAdvance(simCost.digitalWrite);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+	simAdvance(simCost.digitalWrite);
+	if (pin < 8)
+		PORTD.setBit(pin, value != LOW);
+	else if (pin < 14)
+		PORTB.setBit(pin - 8, value != LOW);
+	else if (pin < SIM_PINS)
+		PORTC.setBit(pin - 14, value != LOW);
+	setPin(pin, value != LOW);
+}
+
+int digitalRead(uint8_t pin)
+{
+	simAdvance(simCost.digitalWrite);
+	return (pin < SIM_PINS) ? s_pins[pin] : LOW;
+}
+
+uint8_t simPin(uint8_t pin)
+{
+	return (pin < SIM_PINS) ? s_pins[pin] : LOW;
+}
+
+unsigned long simRisingEdges(uint8_t pin)
+{
+	return (pin < SIM_PINS) ? s_rising[pin] : 0;
+}
+
+int analogRead(uint8_t pin)
+{
+	if (pin >= A0)
+		pin -= A0;
+	simAdvance(simCost.analogRead);
+	return (pin < 6) ? s_analog[pin] : 0;
+}
+
+void simSetAnalog(uint8_t channel, int value)
+{
+	if (channel < 6)
+		s_analog[channel] = value;
+}
+
+/* Print, as the Arduino core */
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+	size_t n = 0;
+	while (size--)
+		n += write(*buffer++);
+	return n;
+}
+
+size_t Print::print(long n, int base)
+{
+	if (base == 0)
+		return write((uint8_t)n);
+	if (base == 10 && n < 0)
+		return print('-') + printNumber(-n, 10);
+	return printNumber(n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+	if (base == 0)
+		return write((uint8_t)n);
+	return printNumber(n, base);
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base)
+{
+	char buf[8 * sizeof(long) + 1];
+	char* str = &buf[sizeof(buf) - 1];
+
+	*str = '\0';
+	if (base < 2)
+		base = 10;
+	do {
+		unsigned long m = n;
+		n /= base;
+		char c = m - base * n;
+		*--str = c < 10 ? c + '0' : c + 'A' - 10;
+	} while (n);
+	return write(str);
+}
+
+/* double is float on the AVR, so this works in floats to print the same digits */
+size_t Print::print(double number, int digits)
+{
+	float value = number;
+	size_t n = 0;
+
+	if (isnan(value))
+		return print("nan");
+	if (isinf(value))
+		return print("inf");
+	if (value > 4294967040.0f || value < -4294967040.0f)
+		return print("ovf");
+	if (value < 0.0f)
+	{
+		n += print('-');
+		value = -value;
+	}
+	float rounding = 0.5f;
+	for (int i = 0; i < digits; i++)
+		rounding /= 10.0f;
+	value += rounding;
+
+	unsigned long whole = (unsigned long)value;
+	float remainder = value - (float)whole;
+	n += print(whole);
+	if (digits > 0)
+		n += print('.');
+	while (digits-- > 0)
+	{
+		remainder *= 10.0f;
+		int digit = (int)remainder;
+		n += print(digit);
+		remainder -= digit;
+	}
+	return n;
+}
+
+/* avr-libc's itoa, ltoa and ultoa. Only base 10 is signed, other bases
+   print the bits, of a 32 bit long as on the Uno */
+char* ultoa(unsigned long value, char* s, int radix)
+{
+	char digits[33], *p = s;
+	int i = 0;
+	value &= 0xffffffffUL;
+	do
+	{
+		digits[i++] = "0123456789abcdefghijklmnopqrstuvwxyz"[value % radix];
+		value /= radix;
+	} while (value);
+	while (i)
+		*p++ = digits[--i];
+	*p = '\0';
+	return s;
+}
+
+char* ltoa(long value, char* s, int radix)
+{
+	if (value < 0 && radix == 10)
+	{
+		*s = '-';
+		ultoa(-(unsigned long)value, s + 1, radix);
+		return s;
+	}
+	return ultoa(value, s, radix);
+}
+
+char* itoa(int value, char* s, int radix)
+{
+	if (radix == 10)
+		return ltoa(value, s, radix);
+	return ultoa((unsigned int)value, s, radix);
+}
+
+/* Serial */
+
+HardwareSerial Serial;
+
+#define SIM_RX_QUEUE 4096
+static uint8_t       s_rxBuffer[SERIAL_BUFFER_SIZE];
+static uint8_t       s_rxHead = 0, s_rxTail = 0;
+static char          s_rxData[SIM_RX_QUEUE];
+static uint64_t      s_rxTime[SIM_RX_QUEUE];
+static unsigned int  s_rxFirst = 0, s_rxCount = 0;
+static uint64_t      s_rxLast = 0;
+static unsigned long s_rxOverruns = 0;
+
+HardwareSerial::HardwareSerial()
+{
+	m_byteTime = 0;
+	m_txDone = 0;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+	// Start bit, 8 data bits and a stop bit
+	m_byteTime = 10 * F_CPU / baud;
+}
+
+int HardwareSerial::queued()
+{
+	if (!m_byteTime || m_txDone <= s_cycles)
+		return 0;
+	return (m_txDone - s_cycles + m_byteTime - 1) / m_byteTime - 1;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+	simAdvance(simCost.serialWrite);
+	if (queued() >= SERIAL_BUFFER_SIZE - 1)
+	{
+		// Wait for room, as the real one does
+		uint64_t room = m_txDone - (SERIAL_BUFFER_SIZE - 1) * m_byteTime;
+		simAdvance((room - s_cycles) * 1000 / CYCLES_PER_US + 1);
+	}
+	m_txDone = max(m_txDone, s_cycles) + m_byteTime;
+	if (simSerialHook)
+		simSerialHook(c);
+	return 1;
+}
+
+int HardwareSerial::availableForWrite()
+{
+	return SERIAL_BUFFER_SIZE - 1 - queued();
+}
+
+void HardwareSerial::flush()
+{
+	if (m_txDone > s_cycles)
+		simAdvance((m_txDone - s_cycles) * 1000 / CYCLES_PER_US + 1);
+}
+
+/* Moves the bytes that have arrived by now into the receive buffer. Nothing
+   is taken out between calls, so doing this late loses the same bytes */
+static void receive()
+{
+	while (s_rxCount && s_rxTime[s_rxFirst] <= s_cycles)
+	{
+		uint8_t head = (s_rxHead + 1) % SERIAL_BUFFER_SIZE;
+		if (head == s_rxTail)
+			s_rxOverruns++;
+		else
+		{
+			s_rxBuffer[s_rxHead] = s_rxData[s_rxFirst];
+			s_rxHead = head;
+		}
+		s_rxFirst = (s_rxFirst + 1) % SIM_RX_QUEUE;
+		s_rxCount--;
+	}
+}
+
+int HardwareSerial::available()
+{
+	receive();
+	return (SERIAL_BUFFER_SIZE + s_rxHead - s_rxTail) % SERIAL_BUFFER_SIZE;
+}
+
+int HardwareSerial::peek()
+{
+	receive();
+	if (s_rxHead == s_rxTail)
+		return -1;
+	return s_rxBuffer[s_rxTail];
+}
+
+int HardwareSerial::read()
+{
+	int c = peek();
+	if (c >= 0)
+		s_rxTail = (s_rxTail + 1) % SERIAL_BUFFER_SIZE;
+	return c;
+}
+
+void simSerialInput(const char* data, size_t len)
+{
+	uint64_t byteTime = 10 * F_CPU / 9600;
+	s_rxLast = max(s_rxLast, s_cycles);
+	while (len-- && s_rxCount < SIM_RX_QUEUE)
+	{
+		unsigned int i = (s_rxFirst + s_rxCount++) % SIM_RX_QUEUE;
+		s_rxLast += byteTime;
+		s_rxData[i] = *data++;
+		s_rxTime[i] = s_rxLast;
+	}
+}
+
+unsigned long simSerialOverruns()
+{
+	return s_rxOverruns;
+}
+
+/* LCD */
+
+static uint8_t s_ddram[2][40];
+static uint8_t s_row = 0, s_col = 0;
+static unsigned long s_lcdChanges = 0;
+
+/* The pins and size are those of the shield, so they aren't kept */
+LiquidCrystal::LiquidCrystal(uint8_t, uint8_t,
+	uint8_t, uint8_t, uint8_t, uint8_t) {}
+LiquidCrystal::LiquidCrystal(uint8_t, uint8_t, uint8_t,
+	uint8_t, uint8_t, uint8_t, uint8_t) {}
+LiquidCrystal::LiquidCrystal(uint8_t, uint8_t,
+	uint8_t, uint8_t, uint8_t, uint8_t,
+	uint8_t, uint8_t, uint8_t, uint8_t) {}
+LiquidCrystal::LiquidCrystal(uint8_t, uint8_t, uint8_t,
+	uint8_t, uint8_t, uint8_t, uint8_t,
+	uint8_t, uint8_t, uint8_t, uint8_t) {}
+
+void LiquidCrystal::begin(uint8_t, uint8_t)
+{
+	// The power up waits and the init sequence
+	simAdvance(65000000);
+	clear();
+}
+
+void LiquidCrystal::clear()
+{
+	simAdvance(simCost.lcdClear);
+	memset(s_ddram, ' ', sizeof(s_ddram));
+	s_row = s_col = 0;
+	s_lcdChanges++;
+}
+
+void LiquidCrystal::home()
+{
+	simAdvance(simCost.lcdClear);
+	s_row = s_col = 0;
+}
+
+void LiquidCrystal::setCursor(uint8_t col, uint8_t row)
+{
+	simAdvance(simCost.lcdCommand);
+	s_row = (row > 1) ? 1 : row;
+	s_col = col % 40;
+}
+
+size_t LiquidCrystal::write(uint8_t c)
+{
+	simAdvance(simCost.lcdCommand);
+	if (s_ddram[s_row][s_col] != c)
+	{
+		s_ddram[s_row][s_col] = c;
+		if (s_col < 16)
+			s_lcdChanges++;
+	}
+	// The address runs on from the end of one line to the start of the other
+	if (++s_col == 40)
+	{
+		s_col = 0;
+		s_row ^= 1;
+	}
+	return 1;
+}
+
+const char* simLcdLine(uint8_t row)
+{
+	static char line[17];
+	for (uint8_t i = 0; i < 16; i++)
+	{
+		uint8_t c = s_ddram[row & 1][i];
+		line[i] = (c >= ' ' && c < 0x7f) ? c : '?';
+	}
+	line[16] = '\0';
+	return line;
+}
+
+unsigned long simLcdChanges()
+{
+	return s_lcdChanges;
+}
+
+/* EEPROM */
+
+uint8_t simEeprom[1024];
+void (*simEepromHook)(int address) = 0;
+EEPROMClass EEPROM;
+
+uint8_t EEPROMClass::read(int address)
+{
+	simAdvance(simCost.eepromRead);
+	return simEeprom[address & 1023];
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+	simAdvance(simCost.eepromWrite);
+	simEeprom[address & 1023] = value;
+	if (simEepromHook)
+		simEepromHook(address);
+}
+
+/* stdio streams */
+
+#define SIM_STREAMS 4
+static struct {
+	FILE*  stream;
+	SimPut put;
+} s_streams[SIM_STREAMS];
+
+/* Output only, so the get function and flags aren't kept */
+void simSetupStream(FILE* stream, SimPut put, SimGet, int)
+{
+	for (uint8_t i = 0; i < SIM_STREAMS; i++)
+	{
+		if (!s_streams[i].stream || s_streams[i].stream == stream)
+		{
+			s_streams[i].stream = stream;
+			s_streams[i].put = put;
+			return;
+		}
+	}
+}
+
+#undef fprintf
+int simFprintf(FILE* stream, const char* format, ...)
+{
+	va_list args;
+	int n;
+
+	va_start(args, format);
+	for (uint8_t i = 0; i < SIM_STREAMS; i++)
+	{
+		if (s_streams[i].stream == stream && s_streams[i].put)
+		{
+			char buf[128];
+			n = vsnprintf(buf, sizeof(buf), format, args);
+			va_end(args);
+			for (int j = 0; j < n && j < (int)sizeof(buf) - 1; j++)
+			{
+				simAdvance(simCost.format);
+				s_streams[i].put(buf[j], stream);
+			}
+			return n;
+		}
+	}
+	n = vfprintf(stream, format, args);
+	va_end(args);
+	return n;
+}
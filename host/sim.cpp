@@ -0,0 +1,444 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+/* Runs the firmware on the host against a script of key presses, and traces
+   the LCD, Serial output and chosen pins against the virtual clock.
+
+   weldsim [-q] [-t seconds] [-e eeprom.bin] [-k writes] [-w pin]... [-f script] [script...]
+
+   The script is a list of keys, each pressed and released in turn:
+	S L R U D	SELECT, LEFT, RIGHT, UP or DOWN, held for 150ms
+	U:2000		UP held for 2000ms
+	W:5000		Wait 5000ms with no key pressed
+	T:$P		Send $P and a newline to Serial, taking no script time
+	F:0101		Send a frame of the protocol in link.h, of the type
+			then the data in hex, taking no script time
+	E:ok		Expect Serial to have sent a line holding ok, after
+			the line the last E: found. _ stands for a space
+	P:18=100	Expect pin 18 to have gone HIGH 100 times so far
+   Each key is followed by 150ms with no key pressed. Anything after a #
+   in a script file is a comment. The script starts when setup() returns,
+   and the run ends with it, or after -t seconds of virtual time. An
+   expectation that isn't met is printed, and weldsim exits with 1, so the
+   scripts in tests/ are run by "make test".
+
+   -e loads the EEPROM from the file if there is one, and saves it at the end
+   -k cuts the power after that many EEPROM writes, saving the EEPROM as it
+      is then, to check what the firmware makes of it on the next run
+   -w traces changes to a pin, eg -w 17 for the relay on A3
+   -q leaves out the LCD trace
+
+   Frames sent by the firmware are traced on a line each, in hex */
+#include <ctype.h>
+#include <string>
+#include "Arduino.h"
+#include "sim.h"
+#include "keypad.h"
+#include "link.h"
+
+/* The analog channel of pKEY in main.cpp */
+#define KEY_CHANNEL 0
+
+#define KEY_HOLD 150
+#define KEY_GAP  150
+
+#define MAX_EVENTS 4096
+static struct {
+	uint64_t at;	/* ns */
+	uint8_t  key;
+	const char* text;	/* Sent to Serial instead of pressing the key */
+	size_t length;
+	char check;		/* E or P to check text or pin instead */
+	uint8_t pin;
+	unsigned long count;	/* Rising edges P expects */
+} events[MAX_EVENTS];
+static int numEvents = 0;
+static uint64_t scriptEnd = 0;
+
+static bool watched[20];
+static bool quiet = false;
+
+static void trace(const char* what)
+{
+	printf("%11.6f %s\n", simNanos() / 1e9, what);
+}
+
+/* The ADC reading for a key, half way between its threshold and the next */
+static int keyValue(uint8_t key)
+{
+	for (uint8_t i = 0; i < 5; i++)
+	{
+		if (adc_key_val[i][1] == key)
+			return (adc_key_val[i][0] + (i < 4 ? adc_key_val[i + 1][0] : 0)) / 2;
+	}
+	return 1023;
+}
+
+static void addEvent(uint8_t key, const char* text = NULL, size_t length = 0)
+{
+	if (numEvents < MAX_EVENTS)
+	{
+		events[numEvents].at = scriptEnd;
+		events[numEvents].text = text;
+		events[numEvents].length = length;
+		events[numEvents].check = 0;
+		events[numEvents++].key = key;
+	}
+}
+
+static void addCheck(char check, const char* text, uint8_t pin = 0, unsigned long count = 0)
+{
+	if (numEvents < MAX_EVENTS)
+	{
+		addEvent(BTN_NONE, text);
+		events[numEvents - 1].check = check;
+		events[numEvents - 1].pin = pin;
+		events[numEvents - 1].count = count;
+	}
+}
+
+static bool parseToken(const char* token)
+{
+	static const char keys[] = "SLDUR";
+	static const uint8_t codes[] = { BTN_SELECT, BTN_LEFT, BTN_DOWN, BTN_UP, BTN_RIGHT };
+	char c = toupper(token[0]);
+	unsigned long ms = KEY_HOLD;
+
+	if (c == 'T' && token[1] == ':')
+	{
+		char* text = (char*)malloc(strlen(token + 2) + 2);
+		sprintf(text, "%s\n", token + 2);
+		addEvent(BTN_NONE, text, strlen(text));
+		return true;
+	}
+	if (c == 'E' && token[1] == ':' && token[2])
+	{
+		char* text = strdup(token + 2);
+		for (char* p = text; (p = strchr(p, '_')); )
+			*p = ' ';
+		addCheck('E', text);
+		return true;
+	}
+	if (c == 'P' && token[1] == ':')
+	{
+		char* end;
+		unsigned long pin = strtoul(token + 2, &end, 10);
+		if (end == token + 2 || *end != '=' || pin >= 20)
+			return false;
+		addCheck('P', NULL, pin, strtoul(end + 1, NULL, 10));
+		return true;
+	}
+	if (c == 'F' && token[1] == ':')
+	{
+		size_t hex = strlen(token + 2), n = hex / 2;
+		char* frame;
+		unsigned int byte;
+		uint8_t crc = 0;
+		if (!n || hex % 2)
+			return false;
+		frame = (char*)malloc(n + 3);
+		frame[0] = LINK_STX;
+		frame[1] = n - 1;
+		for (size_t i = 0; i < n; i++)
+		{
+			if (sscanf(token + 2 + i * 2, "%2x", &byte) != 1)
+			{
+				free(frame);
+				return false;
+			}
+			frame[2 + i] = byte;
+		}
+		for (size_t i = 1; i < n + 2; i++)
+			crc = crc8(crc, frame[i]);
+		frame[n + 2] = crc;
+		addEvent(BTN_NONE, frame, n + 3);
+		return true;
+	}
+	if (token[1] == ':')
+		ms = strtoul(token + 2, NULL, 10);
+	else if (token[1])
+		return false;
+
+	if (c == 'W')
+	{
+		scriptEnd += ms * 1000000ULL;
+		return true;
+	}
+	const char* k = strchr(keys, c);
+	if (!c || !k)
+		return false;
+	addEvent(codes[k - keys]);
+	scriptEnd += ms * 1000000ULL;
+	addEvent(BTN_NONE);
+	scriptEnd += KEY_GAP * 1000000ULL;
+	return true;
+}
+
+static bool parseFile(const char* name)
+{
+	FILE* f = fopen(name, "r");
+	char line[256];
+	if (!f)
+	{
+		perror(name);
+		return false;
+	}
+	while (fgets(line, sizeof(line), f))
+	{
+		char* token;
+		if ((token = strchr(line, '#')))
+			*token = '\0';
+		for (token = strtok(line, " \t\r\n"); token; token = strtok(NULL, " \t\r\n"))
+		{
+			if (!parseToken(token))
+			{
+				fprintf(stderr, "%s: bad token %s\n", name, token);
+				fclose(f);
+				return false;
+			}
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+/* Serial output is traced a line at a time, or a frame at a time */
+static char txLine[256];
+static size_t txLength = 0;
+static int frameLeft = -1;	/* Bytes to the end of a frame, -1 if not in one */
+static std::string sent;	/* Every line traced, for E: */
+static size_t expectFrom = 0;	/* Where the next E: looks from */
+static bool failed = false;
+
+static void flushSerial()
+{
+	if (txLength)
+	{
+		txLine[txLength] = '\0';
+		printf("%11.6f tx  %s\n", simNanos() / 1e9, txLine);
+		sent += txLine;
+		sent += '\n';
+		txLength = 0;
+	}
+}
+
+/* An E: or P: of the script */
+static void check(const char* text, char what, uint8_t pin, unsigned long count)
+{
+	char line[300];
+	size_t at;
+
+	if (what == 'E')
+	{
+		at = sent.find(text, expectFrom);
+		if (at != std::string::npos)
+		{
+			expectFrom = sent.find('\n', at) + 1;
+			return;
+		}
+		snprintf(line, sizeof(line), "FAIL expected %s", text);
+	}
+	else
+	{
+		if (simRisingEdges(pin) == count)
+			return;
+		snprintf(line, sizeof(line), "FAIL expected pin %d HIGH %lu times, not %lu",
+			pin, count, simRisingEdges(pin));
+	}
+	trace(line);
+	fprintf(stderr, "%.6f %s\n", simNanos() / 1e9, line);
+	failed = true;
+}
+
+static void serialHook(uint8_t c)
+{
+	if (frameLeft < 0 && c == LINK_STX)
+	{
+		flushSerial();
+		txLength = sprintf(txLine, "frame");
+		frameLeft = 0;
+	}
+	else if (frameLeft >= 0)
+	{
+		if (txLength == 5)
+			frameLeft = c + 2;	// The length, then the type, data and CRC
+		else if (--frameLeft == 0)
+			frameLeft = -1;
+		txLength += sprintf(txLine + txLength, " %02x", c);
+		if (frameLeft < 0)
+			flushSerial();
+	}
+	else if (c == '\n')
+		flushSerial();
+	else if (c == '\r' || txLength > sizeof(txLine) - 5)
+		return;
+	else if (c >= ' ' && c < 0x7f)
+		txLine[txLength++] = c;
+	else
+		txLength += sprintf(txLine + txLength, "\\x%02x", c);
+}
+
+static void pinHook(uint8_t pin, uint8_t value)
+{
+	if (pin < 20 && watched[pin])
+		printf("%11.6f pin %d %s\n", simNanos() / 1e9, pin, value ? "HIGH" : "LOW");
+}
+
+static const char* eeprom = NULL;
+static unsigned long writesLeft = 0;
+
+static void saveEeprom()
+{
+	if (eeprom)
+	{
+		FILE* f = fopen(eeprom, "wb");
+		if (!f || fwrite(simEeprom, 1, sizeof(simEeprom), f) != sizeof(simEeprom))
+			perror(eeprom);
+		if (f)
+			fclose(f);
+	}
+}
+
+static void eepromHook(int)
+{
+	if (writesLeft && !--writesLeft)
+	{
+		flushSerial();
+		trace("power cut");
+		saveEeprom();
+		exit(failed ? 1 : 0);
+	}
+}
+
+static void traceLCD()
+{
+	static unsigned long changes = 0;
+	char top[17], line[40];
+	if (quiet || changes == simLcdChanges())
+		return;
+	changes = simLcdChanges();
+	strcpy(top, simLcdLine(0));
+	snprintf(line, sizeof(line), "lcd |%s|%s|", top, simLcdLine(1));
+	trace(line);
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: weldsim [-q] [-t seconds] [-e eeprom.bin] [-k writes] [-w pin]... [-f script] [script...]\n");
+	exit(1);
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t limit = 0;
+	int i;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if (!strcmp(argv[i], "-q"))
+			quiet = true;
+		else if (i + 1 == argc)
+			usage();
+		else if (!strcmp(argv[i], "-t"))
+			limit = strtod(argv[++i], NULL) * 1e9;
+		else if (!strcmp(argv[i], "-e"))
+			eeprom = argv[++i];
+		else if (!strcmp(argv[i], "-k"))
+			writesLeft = strtoul(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-w"))
+		{
+			int pin = atoi(argv[++i]);
+			if (pin < 0 || pin >= 20)
+				usage();
+			watched[pin] = true;
+		}
+		else if (!strcmp(argv[i], "-f"))
+		{
+			if (!parseFile(argv[++i]))
+				return 1;
+		}
+		else
+			usage();
+	}
+	for (; i < argc; i++)
+	{
+		if (!parseToken(argv[i]))
+		{
+			fprintf(stderr, "bad token %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (eeprom)
+	{
+		FILE* f = fopen(eeprom, "rb");
+		if (f)
+		{
+			if (fread(simEeprom, 1, sizeof(simEeprom), f) != sizeof(simEeprom))
+				fprintf(stderr, "%s: short read\n", eeprom);
+			fclose(f);
+		}
+	}
+	simSerialHook = serialHook;
+	simPinHook = pinHook;
+	simEepromHook = eepromHook;
+
+	// As the Arduino core's main()
+	sei();
+	setup();
+	traceLCD();
+
+	// The script starts once setup() is done
+	uint64_t start = simNanos();
+	uint64_t end = limit ? limit : start + scriptEnd;
+	int next = 0;
+	while (simNanos() < end)
+	{
+		for (; next < numEvents && start + events[next].at <= simNanos(); next++)
+		{
+			if (events[next].check)
+				check(events[next].text, events[next].check,
+					events[next].pin, events[next].count);
+			else if (events[next].text)
+				simSerialInput(events[next].text, events[next].length);
+			else
+				simSetAnalog(KEY_CHANNEL, keyValue(events[next].key));
+		}
+		loop();
+		simAdvance(simCost.loop);
+		traceLCD();
+	}
+	flushSerial();
+	// Checks at the end of the script
+	for (; next < numEvents; next++)
+	{
+		if (events[next].check)
+			check(events[next].text, events[next].check,
+				events[next].pin, events[next].count);
+	}
+	trace("end");
+
+	for (i = 0; i < 20; i++)
+	{
+		if (simRisingEdges(i))
+			printf("%11.6f pin %d went HIGH %lu times\n",
+				simNanos() / 1e9, i, simRisingEdges(i));
+	}
+	saveEeprom();
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+/* Control side of the simulated Arduino used by the host build.
+
+   Time is virtual. It only moves on when the firmware calls something that
+   takes time on the real board (analogRead(), an LCD write, delay() ...),
+   or when the simulation moves it on itself, by the costs in simCost.
+   Timer1 counts against the virtual clock, as does the ADC when it converts
+   by itself, and their interrupts are taken at the exact virtual time they
+   fall due, unless interrupts are disabled. */
+#ifndef SIM_H
+#define SIM_H
+#include <stdint.h>
+#include <stddef.h>
+
+/* Virtual time taken by each operation, in nanoseconds. The defaults are
+   rough figures for a 16MHz Uno running the Arduino 1.0 core */
+struct SimCosts {
+	unsigned long loop;		/* Each pass of loop(), less the calls below */
+	unsigned long micros;
+	unsigned long millis;
+	unsigned long digitalWrite;
+	unsigned long analogRead;
+	unsigned long lcdCommand;	/* setCursor() etc, and each char written */
+	unsigned long lcdClear;		/* clear() and home() */
+	unsigned long format;		/* Each char formatted by fprintf() */
+	unsigned long serialWrite;	/* Each char, when there is room to buffer it */
+	unsigned long eepromRead;
+	unsigned long eepromWrite;
+	unsigned long isr;		/* Entry and exit of each interrupt handler */
+};
+extern SimCosts simCost;
+
+/* Virtual time since reset */
+uint64_t simNanos();
+
+/* Moves the clock on, taking any interrupts that fall due on the way */
+void simAdvance(uint64_t ns);
+
+/* Value of channel 0 to 5 for analogRead() and ADC conversions */
+void simSetAnalog(uint8_t channel, int value);
+
+/* Sends bytes to Serial. They arrive one after another at the baud rate,
+   and any that arrive while the 64 byte receive buffer is full are lost */
+void simSerialInput(const char* data, size_t len);
+unsigned long simSerialOverruns();
+
+/* Called with each byte written to Serial, and each pin change */
+extern void (*simSerialHook)(uint8_t c);
+extern void (*simPinHook)(uint8_t pin, uint8_t value);
+
+/* Pin states, and how many times each pin has gone HIGH */
+uint8_t simPin(uint8_t pin);
+unsigned long simRisingEdges(uint8_t pin);
+
+/* The 16 visible chars of an LCD row, and a count of changes to the
+   display so a caller can tell when to look again */
+const char* simLcdLine(uint8_t row);
+unsigned long simLcdChanges();
+
+/* The EEPROM contents, and a hook called after each byte is written */
+extern uint8_t simEeprom[1024];
+extern void (*simEepromHook)(int address);
+
+#endif
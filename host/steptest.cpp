@@ -0,0 +1,784 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+/* Pass/fail checks of the step output of AccelStepper on the simulated Arduino.
+
+   steptest [-v] [check]...
+   steptest -i intervals.txt
+   steptest -c intervals.txt
+
+   Runs every check, or only those named, and prints a line for each that
+   fails. Exits with 1 if any fail, so "make test" stops. -v prints a line for
+   each check that passes too.
+
+   -i writes the step intervals of a set of standard profiles to a file, and
+   -c compares them with a file written by another build. "make test" builds
+   steptest-fixed with ACCELSTEPPER_FIXED_POINT, and compares the two, so
+   the fixed point maths is held to the limits AccelStepper.h gives for it.
+
+   Each check records every change of the STEP and DIR pins against the
+   virtual clock, and compares them with what the motor driver needs and
+   with the ideal step times. Unlike stepbench, which reports how good the
+   timing is, these only ask whether it is right. */
+#include <vector>
+#include <stdarg.h>
+#include "Arduino.h"
+#include <AccelStepper.h>
+#include <StepTimer.h>
+#include <StepQueue.h>
+#include <StepperGroup.h>
+#include <SegmentPlanner.h>
+#include "sim.h"
+
+/* As main.cpp, and for the other axes of a StepperGroup */
+enum { pSTEP = A4, pDIR = A5, pSTEP2 = 2, pDIR2 = 3, pSTEP3 = 11, pDIR3 = 12, PINS = 20 };
+
+struct Edge {
+	double  time;	/* us */
+	uint8_t pin;
+	uint8_t value;
+};
+
+static std::vector<Edge> edges;
+static uint8_t startLevel[PINS];	/* Pins when edges was cleared */
+static const char* checkName;
+static bool failed;
+static bool verbose = false;
+
+static void pinHook(uint8_t pin, uint8_t value)
+{
+	if (pin >= PINS)
+		return;
+	Edge e = { simNanos() / 1000.0, pin, value };
+	edges.push_back(e);
+}
+
+/* Reports a failure of the current check. Only the first of each check is
+   printed, the rest would usually follow from it */
+static bool fail(const char* format, ...)
+{
+	va_list args;
+	if (!failed)
+	{
+		printf("FAIL %s: ", checkName);
+		va_start(args, format);
+		vprintf(format, args);
+		va_end(args);
+		printf("\n");
+	}
+	failed = true;
+	return false;
+}
+
+/* Times of the STEP rising edges, in us from the first */
+static std::vector<double> stepTimes(uint8_t stepPin = pSTEP)
+{
+	std::vector<double> times;
+	for (size_t i = 0; i < edges.size(); i++)
+		if (edges[i].pin == stepPin && edges[i].value)
+			times.push_back(edges[i].time);
+	for (size_t k = times.size(); k-- > 0;)
+		times[k] -= times[0];
+	return times;
+}
+
+/* Whether the STEP and DIR edges meet the driver's timing: STEP high and low
+   for at least width us, DIR changed at least setup us before each rising
+   edge and not while STEP is high, and STEP left low at the end. Sets *steps
+   to the net steps taken, counting those with DIR high as forward */
+static bool checkPulses(double width, double setup, long* steps,
+			uint8_t stepPin = pSTEP, uint8_t dirPin = pDIR)
+{
+	double rose = -1e9, fell = -1e9, dirChanged = -1e9;
+	uint8_t step = LOW, dir = startLevel[dirPin];
+
+	*steps = 0;
+	for (size_t i = 0; i < edges.size(); i++)
+	{
+		const Edge& e = edges[i];
+		if (e.pin != stepPin && e.pin != dirPin)
+			continue;
+		if (e.pin == dirPin)
+		{
+			if (step)
+				return fail("DIR changed at %.1fus while STEP was high", e.time);
+			dir = e.value;
+			dirChanged = e.time;
+		}
+		else if (e.value)
+		{
+			if (e.time - fell < width - 0.01)
+				return fail("STEP low for %.1fus at %.1fus, less than %gus", e.time - fell, e.time, width);
+			if (e.time - dirChanged < setup - 0.01)
+				return fail("STEP rose %.1fus after DIR at %.1fus, less than %gus",
+					    e.time - dirChanged, e.time, setup);
+			*steps += dir ? 1 : -1;
+			step = HIGH;
+			rose = e.time;
+		}
+		else
+		{
+			if (e.time - rose < width - 0.01)
+				return fail("STEP high for %.1fus at %.1fus, less than %gus", e.time - rose, e.time, width);
+			step = LOW;
+			fell = e.time;
+		}
+	}
+	if (simPin(stepPin))
+		return fail("STEP left high");
+	return true;
+}
+
+static void clearEdges()
+{
+	edges.clear();
+	for (uint8_t pin = 0; pin < PINS; pin++)
+		startLevel[pin] = simPin(pin);
+}
+
+static void setUp(AccelStepper& stepper, float speed)
+{
+	stepper.setMaxSpeed(speed);
+	stepper.setCurrentPosition(0);
+	clearEdges();
+	StepTimer::resetStats();
+}
+
+static void runTimer(AccelStepper& stepper, boolean accelerate)
+{
+	StepTimer::begin(&stepper, accelerate);
+	while (StepTimer::running())
+		simAdvance(simCost.loop);
+}
+
+/* Every step at constant speed from StepTimer is within a timer tick or two of
+   k / speed after the first, with no missed deadlines */
+static void checkTimer()
+{
+	static const float speeds[] = { 100, 2000, 8000 };
+	for (size_t s = 0; s < sizeof(speeds) / sizeof(speeds[0]); s++)
+	{
+		AccelStepper stepper(AccelStepper::DRIVER, pSTEP, pDIR);
+		setUp(stepper, speeds[s]);
+		stepper.moveTo(500);
+		stepper.setSpeed(speeds[s]);
+		runTimer(stepper, false);
+
+		std::vector<double> times = stepTimes();
+		if (times.size() != 500)
+			return (void)fail("%g steps/s took %u steps, not 500", speeds[s], (unsigned)times.size());
+		for (size_t k = 0; k < times.size(); k++)
+		{
+			double err = times[k] - k * 1e6 / speeds[s];
+			if (fabs(err) > 2.0)
+				return (void)fail("%g steps/s step %u is %.1fus off", speeds[s], (unsigned)k, err);
+		}
+		if (StepTimer::missedDeadlines())
+			return (void)fail("%g steps/s missed %lu deadlines", speeds[s], StepTimer::missedDeadlines());
+	}
+}
+
+/* An accelerating move from StepTimer takes the right number of steps, ends at
+   the target, and takes the time of the ideal trapezoid to within the error
+   of the approximation AccelStepper makes for the first step */
+static void checkTimerAccel()
+{
+	AccelStepper stepper(AccelStepper::DRIVER, pSTEP, pDIR);
+	const double speed = 2000, accel = 10000;
+	const long distance = 1000;
+	setUp(stepper, speed);
+	stepper.setAcceleration(accel);
+	stepper.moveTo(distance);
+	runTimer(stepper, true);
+
+	std::vector<double> times = stepTimes();
+	if ((long)times.size() != distance || stepper.currentPosition() != distance)
+		return (void)fail("took %u steps to %ld, not %ld", (unsigned)times.size(),
+				  stepper.currentPosition(), distance);
+	double ramp = speed / accel;
+	double ideal = (2.0 * ramp + (distance - 1 - speed * ramp) / speed) * 1e6;
+	double err = (times.back() - ideal) / ideal * 100.0;
+	if (fabs(err) > 2.0)
+		fail("took %.0fus, %.2f%% off the ideal %.0fus", times.back(), err, ideal);
+}
+
+/* Non-blocking pulses, from StepTimer and polled runSpeed() and run(), with a
+   change of direction, meet the driver's timing and end at the target */
+static void checkPulse()
+{
+	static const char* modes[] = { "timer", "timerAccel", "runSpeed", "run" };
+	const float speed = 8000;
+	const unsigned int width = 10, setup = 20;
+
+	for (int mode = 0; mode < 4; mode++)
+	{
+		AccelStepper stepper(AccelStepper::DRIVER, pSTEP, pDIR);
+		stepper.setNonBlockingPulse(true);
+		stepper.setMinPulseWidth(width);
+		stepper.setDirectionSetupTime(setup);
+		setUp(stepper, speed);
+		stepper.setAcceleration(100000);
+
+		static const long targets[] = { 200, -100 };
+		for (int t = 0; t < 2; t++)
+		{
+			stepper.moveTo(targets[t]);
+			switch (mode)
+			{
+				case 0:
+				case 1:
+					if (mode == 0)
+						stepper.setSpeed(targets[t] > 0 ? speed : -speed);
+					runTimer(stepper, mode == 1);
+					break;
+				case 2:
+					stepper.setSpeed(targets[t] > 0 ? speed : -speed);
+					while (stepper.distanceToGo())
+					{
+						stepper.runSpeedToPosition();
+						simAdvance(simCost.loop);
+					}
+					break;
+				case 3:
+					while (stepper.run())
+						simAdvance(simCost.loop);
+					break;
+			}
+		}
+		// Polled, the last pulse is ended by the next poll once stopped
+		stepper.setSpeed(0);
+		for (int i = 0; mode >= 2 && i < 10; i++)
+		{
+			stepper.runSpeed();
+			simAdvance(simCost.loop);
+		}
+
+		long steps;
+		if (!checkPulses(width, setup, &steps))
+			return (void)printf("  in %s\n", modes[mode]);
+		if (steps != -100 || stepper.currentPosition() != -100)
+			return (void)fail("%s took %ld steps to %ld, not to -100", modes[mode],
+					  steps, stepper.currentPosition());
+	}
+}
+
+/* Interrupts held off for several steps in the middle of a StepTimer run.
+   Stepping makes up the lost time if it is no more steps than the stepper's
+   setMaxCatchUp() allows. Otherwise the schedule restarts without a burst
+   of fast steps, and the run takes longer */
+static void checkCatchUp()
+{
+	static const uint8_t catchUps[] = { 0, 2, 10 };
+	const double speed = 1000, stall = 5500;
+	const long distance = 50;
+
+	for (size_t c = 0; c < sizeof(catchUps) / sizeof(catchUps[0]); c++)
+	{
+		AccelStepper stepper(AccelStepper::DRIVER, pSTEP, pDIR);
+		setUp(stepper, speed);
+		stepper.setMaxCatchUp(catchUps[c]);
+		stepper.moveTo(distance);
+		stepper.setSpeed(speed);
+		StepTimer::begin(&stepper);
+		simAdvance(20500000);
+		uint8_t oldSREG = SREG;
+		cli();
+		simAdvance(stall * 1000);
+		SREG = oldSREG;
+		while (StepTimer::running())
+			simAdvance(simCost.loop);
+
+		std::vector<double> times = stepTimes();
+		if ((long)times.size() != distance)
+			return (void)fail("catch up %u took %u steps, not %ld", catchUps[c],
+					  (unsigned)times.size(), distance);
+		double shortest = 1e9;
+		for (size_t k = 1; k < times.size(); k++)
+			shortest = min(shortest, times[k] - times[k - 1]);
+		double late = times.back() - (distance - 1) * 1e6 / speed;
+		if (!StepTimer::missedDeadlines())
+			return (void)fail("catch up %u missed no deadlines", catchUps[c]);
+		if (StepTimer::maxLatency() < stall - 1000 * 1e6 / speed)
+			return (void)fail("catch up %u latency %uus, less than the stall", catchUps[c],
+					  StepTimer::maxLatency());
+		if (stall < catchUps[c] * 1e6 / speed)
+		{
+			if (fabs(late) > 2.0)
+				return (void)fail("catch up %u ended %.1fus late", catchUps[c], late);
+		}
+		else if (late < stall - 2 * 1e6 / speed || shortest < 1e6 / speed - 2.0)
+			return (void)fail("catch up %u ended %.1fus late, with a step %.1fus after the last",
+					  catchUps[c], late, shortest);
+	}
+}
+
+/* A StepperGroup of three axes, the master faster than two pulse widths a step
+   and one slave stepping with it. Every axis arrives, the pulses meet the
+   driver's timing, and each slave is within half a step of the line at every
+   master step */
+static void checkGroup()
+{
+	static const uint8_t stepPins[] = { pSTEP, pSTEP2, pSTEP3 };
+	static const uint8_t dirPins[] = { pDIR, pDIR2, pDIR3 };
+	static long targets[] = { 1000, 1000, -370 };
+	const unsigned int width = 50, setup = 20;
+	AccelStepper axes[3] = {
+		AccelStepper(AccelStepper::DRIVER, pSTEP, pDIR),
+		AccelStepper(AccelStepper::DRIVER, pSTEP2, pDIR2),
+		AccelStepper(AccelStepper::DRIVER, pSTEP3, pDIR3)
+	};
+	StepperGroup group;
+
+	for (int i = 0; i < 3; i++)
+	{
+		axes[i].setNonBlockingPulse(true);
+		axes[i].setMinPulseWidth(width);
+		axes[i].setDirectionSetupTime(setup);
+		setUp(axes[i], 12000);
+		axes[i].setAcceleration(200000);
+		group.addStepper(axes[i]);
+	}
+	group.moveTo(targets);
+	while (group.run())
+		simAdvance(simCost.loop);
+	for (int i = 0; i < 10; i++)
+	{
+		group.run();
+		simAdvance(simCost.loop);
+	}
+
+	long position[3] = { 0, 0, 0 };
+	for (int i = 0; i < 3; i++)
+	{
+		long steps;
+		if (!checkPulses(width, setup, &steps, stepPins[i], dirPins[i]))
+			return (void)printf("  on axis %d\n", i);
+		if (steps != targets[i] || axes[i].currentPosition() != targets[i])
+			return (void)fail("axis %d took %ld steps to %ld, not to %ld", i, steps,
+					  axes[i].currentPosition(), targets[i]);
+	}
+
+	// The slaves step just after the master, so compare them at the next master step
+	for (size_t n = 0; n < edges.size(); n++)
+	{
+		const Edge& e = edges[n];
+		for (int i = 0; i < 3; i++)
+		{
+			if (e.pin == stepPins[i] && e.value)
+				position[i] += (targets[i] > 0) ? 1 : -1;
+		}
+		if (e.pin != pSTEP || !e.value)
+			continue;
+		for (int i = 1; i < 3; i++)
+		{
+			double line = (double)(position[0] - 1) * targets[i] / targets[0];
+			if (fabs(position[i] - line) > 0.5 + 1e-9)
+				return (void)fail("axis %d at %ld, %.2f steps off the line at master step %ld",
+						  i, position[i], position[i] - line, position[0]);
+		}
+	}
+}
+
+#ifndef ACCELSTEPPER_FIXED_POINT
+/* Whether the values rise to a peak and then fall, each allowing for noise of tol */
+static bool unimodal(const std::vector<double>& v, double tol)
+{
+	double high = -1e9, low = 1e9;
+	bool falling = false;
+	for (size_t i = 0; i < v.size(); i++)
+	{
+		if (!falling && v[i] < high - tol)
+			falling = true;
+		if (falling && v[i] > low + tol)
+			return false;
+		high = max(high, v[i]);
+		low = falling ? min(low, v[i]) : v[i];
+	}
+	return true;
+}
+
+/* A jerk limited move from StepTimer. Over windows of steps, long enough to
+   smooth out the rounding of each interval to the microsecond, the speed rises
+   to the maximum and falls again, the acceleration rises to its limit and
+   falls to 0 in the speed up and the mirror of that in the slow down, never
+   beyond the limit, and the ramps take longer than at constant acceleration.
+   The move ends at the target with the right number of steps */
+static void checkSCurve()
+{
+	AccelStepper stepper(AccelStepper::DRIVER, pSTEP, pDIR);
+	const double speed = 4000, accel = 20000, jerk = 200000;
+	const long distance = 3000, window = 32;
+	setUp(stepper, speed);
+	stepper.setAcceleration(accel);
+	stepper.setJerk(jerk);
+	stepper.moveTo(distance);
+	runTimer(stepper, true);
+
+	std::vector<double> times = stepTimes();
+	if ((long)times.size() != distance || stepper.currentPosition() != distance)
+		return (void)fail("took %u steps to %ld, not %ld", (unsigned)times.size(),
+				  stepper.currentPosition(), distance);
+
+	std::vector<double> speeds, accels, up, down;
+	size_t peak = 0, last = 0;
+	for (long k = 0; k + 2 * window < distance; k += window)
+	{
+		double v0 = window * 1e6 / (times[k + window] - times[k]);
+		double v1 = window * 1e6 / (times[k + 2 * window] - times[k + window]);
+		double a = (v1 - v0) / ((times[k + 2 * window] - times[k]) / 2e6);
+		if (fabs(a) > accel * 1.05)
+			return (void)fail("acceleration %.0f at step %ld, over %g", a, k, accel);
+		if (v0 > speed * 1.001)
+			return (void)fail("speed %.0f at step %ld, over %g", v0, k, speed);
+		if (v0 >= speed * 0.999)
+		{
+			if (!peak)
+				peak = speeds.size();
+			last = speeds.size();
+		}
+		speeds.push_back(v0);
+		accels.push_back(a);
+	}
+	if (!peak)
+		return (void)fail("never reached %g steps/s", speed);
+	if (!unimodal(speeds, speed * 0.005))
+		return (void)fail("speed does not rise and then fall");
+	for (size_t i = 0; i < accels.size(); i++)
+	{
+		if (i < peak)
+			up.push_back(accels[i]);
+		else if (i > last)
+			down.push_back(-accels[i]);
+	}
+	if (!unimodal(up, accel * 0.05) || !unimodal(down, accel * 0.05))
+		return (void)fail("acceleration does not rise and then fall in each ramp");
+	double ramp = times[peak * window] / 1e6;
+	if (ramp < speed / accel + 0.5 * accel / jerk)
+		fail("speed up took %.3fs, too short for the jerk limit", ramp);
+}
+#endif
+
+/* A path of SegmentPlanner segments out and back, polled with non-blocking
+   pulses. A segment with no speed is refused. The pulses meet the driver's
+   timing, the motor does not stop at the junctions before the reversal,
+   and it ends back at the start */
+static void checkPlanner()
+{
+	const unsigned int width = 10, setup = 20;
+	AccelStepper stepper(AccelStepper::DRIVER, pSTEP, pDIR);
+	SegmentPlanner planner(stepper);
+
+	stepper.setNonBlockingPulse(true);
+	stepper.setMinPulseWidth(width);
+	stepper.setDirectionSetupTime(setup);
+	setUp(stepper, 10000);
+	planner.setAcceleration(50000);
+	if (planner.add(500, 0))
+		return (void)fail("add() took a segment with no speed");
+	planner.add(1000, 4000);
+	planner.add(3000, 8000);
+	planner.add(3500, 2000);
+	planner.add(0, 10000);
+	while (planner.run())
+		simAdvance(simCost.loop);
+
+	long steps;
+	if (!checkPulses(width, setup, &steps))
+		return;
+	if (steps || stepper.currentPosition())
+		return (void)fail("took %ld steps to %ld, not back to 0", steps, stepper.currentPosition());
+	std::vector<double> times = stepTimes();
+	// Past the speed up from rest, no slower than the slowest segment until the reversal
+	for (size_t k = 100; k < 3400 && k < times.size(); k++)
+		if (times[k] - times[k - 1] > 1e6 / 2000 * 1.05)
+			return (void)fail("stopped for %.0fus at step %u", times[k] - times[k - 1], (unsigned)k);
+}
+
+static void noStep()
+{
+}
+
+/* Tops the queue up with the steps of checkQueue(), the first half forward and the
+   rest back, and returns how many have been pushed */
+static long pushSteps(StepQueue& queue, long pushed, long total, unsigned long interval)
+{
+	while (pushed < total && queue.push(pushed < total - 1 ? interval : 0, pushed < total / 2))
+		pushed++;
+	return pushed;
+}
+
+/* Steps pushed onto a StepQueue by hand, forward then back, taken from StepTimer
+   and polled with run(), with non-blocking pulses: the pulses meet the driver's
+   timing, each step follows the last by its queued interval, and the step
+   after the change of direction by the direction setup time more. Then a
+   profile from fill() ends where the profile does */
+static void checkQueue()
+{
+	const unsigned long interval = 200;
+	const unsigned int width = 10, setup = 20;
+	const long half = 50;
+	AccelStepper stepper(AccelStepper::DRIVER, pSTEP, pDIR);
+	StepQueue queue;
+	long steps;
+
+	stepper.setNonBlockingPulse(true);
+	stepper.setMinPulseWidth(width);
+	stepper.setDirectionSetupTime(setup);
+	for (int polled = 0; polled < 2; polled++)
+	{
+		const char* mode = polled ? "run()" : "StepTimer";
+		long pushed = 0;
+		setUp(stepper, 1000);
+		queue.resetStats();
+		pushed = pushSteps(queue, pushed, 2 * half, interval);
+		if (!polled)
+			StepTimer::begin(&queue, &stepper);
+		while (polled ? queue.run(stepper) : StepTimer::running())
+		{
+			pushed = pushSteps(queue, pushed, 2 * half, interval);
+			simAdvance(simCost.loop);
+		}
+
+		if (!checkPulses(width, setup, &steps))
+			return (void)printf("  from %s\n", mode);
+		std::vector<double> times = stepTimes();
+		if ((long)times.size() != 2 * half || steps || stepper.currentPosition())
+			return (void)fail("%s took %u steps to %ld, not %ld to 0", mode, (unsigned)times.size(),
+					  stepper.currentPosition(), 2 * half);
+		for (long k = 1; k < 2 * half; k++)
+		{
+			// The setup time is counted from when DIR changed, after the latency of the
+			// interrupt. Polled, each part of the step is as late as the poll
+			double gap = times[k] - times[k - 1];
+			double least = (k == half) ? interval + setup : interval;
+			double most = least + (polled ? 50.0 : (k == half) ? 20.0 : 2.0);
+			if (gap < least - 0.01 || gap > most)
+				return (void)fail("%s step %ld came %.1fus after the last, not %gus",
+						  mode, k, gap, least);
+		}
+		if (queue.underruns())
+			return (void)fail("%s had %lu underruns", mode, queue.underruns());
+	}
+
+	// The profile has no outputs of its own
+	AccelStepper profile(noStep, noStep);
+	profile.setMaxSpeed(4000);
+	profile.setAcceleration(20000);
+	profile.moveTo(-1000);
+	queue.clear();
+	clearEdges();
+	queue.fill(profile, true);
+	StepTimer::begin(&queue, &stepper);
+	while (StepTimer::running())
+	{
+		queue.fill(profile, true);
+		simAdvance(simCost.loop);
+	}
+	if (!checkPulses(width, setup, &steps))
+		return;
+	if (steps != -1000 || stepper.currentPosition() != -1000 || profile.currentPosition() != -1000)
+		fail("fill() took %ld steps to %ld, not to -1000", steps, stepper.currentPosition());
+}
+
+static const struct {
+	const char* name;
+	void (*check)();
+} checks[] = {
+	{ "timer",	checkTimer },
+	{ "timerAccel",	checkTimerAccel },
+	{ "pulse",	checkPulse },
+	{ "queue",	checkQueue },
+	{ "catchUp",	checkCatchUp },
+	{ "group",	checkGroup },
+#ifndef ACCELSTEPPER_FIXED_POINT
+	{ "sCurve",	checkSCurve },
+#endif
+	{ "planner",	checkPlanner },
+};
+static const size_t numChecks = sizeof(checks) / sizeof(checks[0]);
+
+/* Standard profiles for comparing builds. Their intervals are worked out by
+   timerStep() alone, with no outputs and no clock, so they are pure maths */
+struct Profile {
+	const char* name;
+	float speed;
+	float accel;		/* 0 for constant speed */
+	long  distance;
+	bool  rampTable;	/* Equation 13 in the floating point build if false */
+};
+
+static const Profile profiles[] = {
+	{ "slow",	1.5,	0,	20,	false },
+	{ "constant",	333.3,	0,	200,	false },
+	{ "fast",	5000,	0,	200,	false },
+	{ "rampTable",	4000,	10000,	2000,	true },
+	{ "short",	4000,	10000,	100,	true },
+	{ "weld",	1122,	20000,	10000,	true },
+	{ "equation13",	4000,	10000,	2000,	false },
+};
+static const size_t numProfiles = sizeof(profiles) / sizeof(profiles[0]);
+
+static std::vector<unsigned long> profileIntervals(const Profile& p)
+{
+	AccelStepper stepper(noStep, noStep);
+	std::vector<unsigned long> intervals;
+	unsigned long interval;
+
+	stepper.setMaxSpeed(p.speed);
+	if (p.accel > 0)
+	{
+		stepper.setAcceleration(p.accel);
+		stepper.setRampTable(p.rampTable);
+	}
+	stepper.moveTo(p.distance);
+	if (p.accel <= 0)
+		stepper.setSpeed(p.speed);
+	while ((interval = stepper.timerStep(p.accel > 0)))
+		intervals.push_back(interval);
+	return intervals;
+}
+
+static int writeIntervals(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		perror(path);
+		return 2;
+	}
+	for (size_t n = 0; n < numProfiles; n++)
+	{
+		std::vector<unsigned long> intervals = profileIntervals(profiles[n]);
+		for (size_t k = 0; k < intervals.size(); k++)
+			fprintf(file, "%s %u %lu\n", profiles[n].name, (unsigned)k, intervals[k]);
+	}
+	fclose(file);
+	return 0;
+}
+
+/* Compares the intervals of this build with those another build wrote with -i.
+   As AccelStepper.h has it, the fixed point build is within 1us of the floating
+   point one at constant speed and with the ramp table. Against Equation 13 it
+   is within 0.4% while speeding up, allowing 1us for rounding, and slows down
+   sooner, so the whole move only has to be within a few percent */
+static int compareIntervals(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	char name[32];
+	unsigned k;
+	unsigned long interval;
+	int failures = 0;
+
+	if (!file)
+	{
+		perror(path);
+		return 2;
+	}
+	std::vector<std::vector<unsigned long> > theirs(numProfiles);
+	while (fscanf(file, "%31s %u %lu", name, &k, &interval) == 3)
+	{
+		size_t n;
+		for (n = 0; n < numProfiles && strcmp(name, profiles[n].name); n++)
+			;
+		if (n < numProfiles)
+			theirs[n].push_back(interval);
+	}
+	fclose(file);
+
+	for (size_t n = 0; n < numProfiles; n++)
+	{
+		const Profile& p = profiles[n];
+		std::vector<unsigned long> ours = profileIntervals(p);
+		checkName = p.name;
+		failed = false;
+		if (ours.size() != theirs[n].size())
+			fail("%u steps here, %u in %s", (unsigned)ours.size(), (unsigned)theirs[n].size(), path);
+		bool exact = p.accel <= 0 || p.rampTable;
+		double ourTime = 0, theirTime = 0;
+		for (size_t i = 0; !failed && i < ours.size(); i++)
+		{
+			double diff = fabs((double)ours[i] - theirs[n][i]);
+			ourTime += ours[i];
+			theirTime += theirs[n][i];
+			if (exact ? diff > 1 : (i < ours.size() / 2 && ours[i] > ours[i + 1] &&
+						diff > 1 + 0.004 * ours[i]))
+				fail("step %u interval %luus here, %luus in %s", (unsigned)i, ours[i],
+				     theirs[n][i], path);
+		}
+		if (!failed && !exact && fabs(theirTime - ourTime) > 0.05 * ourTime)
+			fail("took %.0fus here, %.0fus in %s", ourTime, theirTime, path);
+		if (failed)
+			failures++;
+		else if (verbose)
+			printf("PASS %s\n", checkName);
+	}
+	return failures ? 1 : 0;
+}
+
+static bool wanted(const char* name, int argc, char** argv, int first)
+{
+	if (first == argc)
+		return true;
+	for (int i = first; i < argc; i++)
+		if (!strcmp(argv[i], name))
+			return true;
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	int first = 1, failures = 0;
+
+	if (first < argc && !strcmp(argv[first], "-v"))
+	{
+		verbose = true;
+		first++;
+	}
+	if (first + 2 == argc && !strcmp(argv[first], "-i"))
+		return writeIntervals(argv[first + 1]);
+	if (first + 2 == argc && !strcmp(argv[first], "-c"))
+		return compareIntervals(argv[first + 1]);
+	for (int i = first; i < argc; i++)
+	{
+		size_t n;
+		for (n = 0; n < numChecks && strcmp(argv[i], checks[n].name); n++)
+			;
+		if (n == numChecks)
+		{
+			fprintf(stderr, "usage: steptest [-v] [check]...\n"
+				"       steptest [-v] -i|-c intervals.txt\n");
+			return 2;
+		}
+	}
+
+	simPinHook = pinHook;
+	sei();
+	for (size_t n = 0; n < numChecks; n++)
+	{
+		if (!wanted(checks[n].name, argc, argv, first))
+			continue;
+		checkName = checks[n].name;
+		failed = false;
+		checks[n].check();
+		if (failed)
+			failures++;
+		else if (verbose)
+			printf("PASS %s\n", checkName);
+	}
+	return failures ? 1 : 0;
+}
@@ -5,6 +5,47 @@
 
 #include "AccelStepper.h"
 
+// Number of entries in rampTable
+#define RAMP_TABLE_SIZE 256
+
+// Step interval ratios c(n)/c0 per Equation 13 for the first RAMP_TABLE_SIZE steps of 
+// an acceleration from rest, scaled by 65536. c(0)/c0 is 1.0, which is stored as 65535.
+// Generated by r[0] = 1.0; r[n] = r[n-1] * (1 - 2.0 / (4.0 * n + 1)); rampTable[n] = round(r[n] * 65536)
+static const uint16_t rampTable[RAMP_TABLE_SIZE] PROGMEM = {
+    65535, 39322, 30583, 25878, 22834, 20659, 19006, 17696,
+    16623, 15725, 14958, 14293, 13709, 13192, 12729, 12312,
+    11933, 11587, 11270, 10977, 10706, 10454, 10219,  9999,
+     9793,  9599,  9416,  9244,  9080,  8925,  8777,  8637,
+     8503,  8375,  8253,  8136,  8024,  7916,  7812,  7713,
+     7617,  7525,  7436,  7350,  7267,  7186,  7109,  7033,
+     6961,  6890,  6821,  6755,  6690,  6627,  6566,  6507,
+     6449,  6393,  6338,  6284,  6232,  6181,  6132,  6083,
+     6036,  5990,  5944,  5900,  5857,  5815,  5773,  5733,
+     5693,  5654,  5616,  5579,  5542,  5506,  5471,  5437,
+     5403,  5370,  5337,  5305,  5273,  5242,  5212,  5182,
+     5153,  5124,  5096,  5068,  5040,  5013,  4987,  4960,
+     4935,  4909,  4884,  4860,  4835,  4812,  4788,  4765,
+     4742,  4719,  4697,  4675,  4654,  4632,  4611,  4591,
+     4570,  4550,  4530,  4511,  4491,  4472,  4453,  4434,
+     4416,  4398,  4380,  4362,  4344,  4327,  4310,  4293,
+     4276,  4260,  4243,  4227,  4211,  4195,  4180,  4164,
+     4149,  4134,  4119,  4104,  4090,  4075,  4061,  4047,
+     4033,  4019,  4005,  3991,  3978,  3965,  3951,  3938,
+     3925,  3913,  3900,  3887,  3875,  3863,  3850,  3838,
+     3826,  3814,  3803,  3791,  3779,  3768,  3757,  3745,
+     3734,  3723,  3712,  3702,  3691,  3680,  3670,  3659,
+     3649,  3638,  3628,  3618,  3608,  3598,  3588,  3578,
+     3569,  3559,  3550,  3540,  3531,  3521,  3512,  3503,
+     3494,  3485,  3476,  3467,  3458,  3449,  3441,  3432,
+     3423,  3415,  3406,  3398,  3390,  3382,  3373,  3365,
+     3357,  3349,  3341,  3333,  3325,  3318,  3310,  3302,
+     3294,  3287,  3279,  3272,  3264,  3257,  3250,  3242,
+     3235,  3228,  3221,  3214,  3207,  3200,  3193,  3186,
+     3179,  3172,  3166,  3159,  3152,  3145,  3139,  3132,
+     3126,  3119,  3113,  3106,  3100,  3094,  3088,  3081,
+     3075,  3069,  3063,  3057,  3051,  3045,  3039,  3033
+};
+
 #if 0
 // Some debugging assistance
 void dump(uint8_t* p, int l)
@@ -35,14 +76,39 @@ void AccelStepper::move(long relative)
     moveTo(_currentPos + relative);
 }
 
+// Returns the step interval for step n of an acceleration from rest, using rampTable.
+// Past the end of the table c(n) is close enough to proportional to 1/sqrt(n) that
+// c(4n) == c(n)/2, which is good to within 0.4%.
+// Integer only, and the loop runs at most 12 times, so the cost per step is bounded.
+static unsigned long rampInterval(unsigned long c0, unsigned long n)
+{
+    uint8_t shift = 0;
+    while (n >= RAMP_TABLE_SIZE)
+    {
+	n >>= 2;
+	shift++;
+    }
+    uint16_t ratio = pgm_read_word(&rampTable[n]);
+    // c0 * ratio / 65536 without needing a 48 bit product
+    unsigned long interval = (c0 >> 16) * ratio + (((c0 & 0xffff) * ratio) >> 16);
+    return interval >> shift;
+}
+
 // Implements steps according to the current step interval
 // You must call this at least once per step
 // returns true if a step occurred
 boolean AccelStepper::runSpeed()
 {
+    // Finish off a non-blocking step pulse, even if we have now stopped
+    if (_pulseHigh)
+	endPulse(micros());
+
     // Dont do anything unless we actually have a step interval
     if (!_stepInterval)
+    {
+	_onSchedule = false;
 	return false;
+    }
 
     unsigned long time = micros();
     // Gymnastics to detect wrapping of either the nextStepTime and/or the current time
@@ -51,6 +117,10 @@ boolean AccelStepper::runSpeed()
 	|| ((nextStepTime < _lastStepTime) && ((time >= nextStepTime) && (time < _lastStepTime))))
 
     {
+	// A non-blocking pulse may need a little longer before the next can start
+	if (_nonBlockingPulse && !pulseReady(time))
+	    return false;
+
 	if (_direction == DIRECTION_CW)
 	{
 	    // Clockwise
@@ -62,8 +132,26 @@ boolean AccelStepper::runSpeed()
 	    _currentPos -= 1;
 	}
 	step(_currentPos);
+	_pulseTime = time;
+
+	if (!_onSchedule)
+	{
+	    // First step from stopped, which starts the schedule
+	    _onSchedule = true;
+	    _lastStepTime = time;
+	    return true;
+	}
+
+	unsigned long lateness = time - nextStepTime;
+	if (lateness > _maxLateness)
+	    _maxLateness = lateness;
+	if (lateness >= _stepInterval)
+	    _missedDeadlines++; // Should have taken the next step by now too
 
-	_lastStepTime = time;
+	if (_maxCatchUp && lateness < _maxCatchUp * _stepInterval)
+	    _lastStepTime = nextStepTime; // Keep to the schedule, so the next steps catch up
+	else
+	    _lastStepTime = time;
 	return true;
     }
     else
@@ -72,6 +160,33 @@ boolean AccelStepper::runSpeed()
     }
 }
 
+// Lowers STEP at the end of a non-blocking pulse, once it has been high for the minimum pulse width
+void AccelStepper::endPulse(unsigned long time)
+{
+    if (time - _pulseTime >= _minPulseWidth)
+    {
+	setOutputPins(_dirOutput ? 0b10 : 0b00); // step LOW
+	_pulseHigh = false;
+	_pulseTime = time;
+    }
+}
+
+// Whether a non-blocking pulse can start now. STEP must have been low for the minimum
+// pulse width, and DIR set for the direction setup time. Sets DIR if it needs to change.
+boolean AccelStepper::pulseReady(unsigned long time)
+{
+    if (_pulseHigh)
+	return false;
+    if (_direction != _dirOutput)
+    {
+	setOutputPins(_direction ? 0b10 : 0b00);
+	_dirOutput = _direction;
+	_dirTime = micros(); // DIR changed after time, at the end of setOutputPins()
+	return false;
+    }
+    return (time - _pulseTime >= _minPulseWidth) && (time - _dirTime >= _dirSetupTime);
+}
+
 long AccelStepper::distanceToGo()
 {
     return _targetPos - _currentPos;
@@ -94,10 +209,28 @@ void AccelStepper::setCurrentPosition(long position)
     _targetPos = _currentPos = position;
     _n = 0;
     _stepInterval = 0;
+    _onSchedule = false;
 }
 
 void AccelStepper::computeNewSpeed()
 {
+#ifdef ACCELSTEPPER_FIXED_POINT
+    // Fixed point builds always use the ramp table
+    computeNewSpeedTable();
+#else
+    if (_n == 0)
+	_sCurve = _jerk > 0.0; // Profile is chosen at the start of a move
+    if (_sCurve)
+    {
+	computeNewSpeedSCurve();
+	return;
+    }
+    if (_rampTable)
+    {
+	computeNewSpeedTable();
+	return;
+    }
+
     long distanceTo = distanceToGo(); // +ve is clockwise from curent location
 
     long stepsToStop = (long)((_speed * _speed) / (2.0 * _acceleration)); // Equation 16
@@ -106,6 +239,7 @@ void AccelStepper::computeNewSpeed()
     {
 	// We are at the target and its time to stop
 	_stepInterval = 0;
+	_onSchedule = false;
 	_speed = 0.0;
 	_n = 0;
 	return;
@@ -176,6 +310,203 @@ void AccelStepper::computeNewSpeed()
     Serial.println(stepsToStop);
     Serial.println("-----");
 #endif
+#endif
+}
+
+#ifndef ACCELSTEPPER_FIXED_POINT
+// Distance to stop with the jerk limit: bring the acceleration down to the peak deceleration,
+// hold it, then bring it back to 0 just as the speed reaches 0. If the speed is too low
+// to reach full deceleration, the peak is lower.
+float AccelStepper::sCurveStopDistance(float v, float a)
+{
+    float j = _jerk;
+    if (a < 0 && v <= a * a / (2.0 * j))
+    {
+	// Braking hard enough to stop while easing off straight away. 
+	// The speed gets to 0 when v + at + jt^2/2 == 0
+	float t = (-a - sqrt(a * a - 2.0 * j * v)) / j;
+	return t * (v + t * (a / 2.0 + j * t / 6.0));
+    }
+    float peak = sqrt(j * v + a * a / 2.0);
+    peak = min(peak, _acceleration);
+
+    // Acceleration a down to -peak
+    float t1 = (a + peak) / j;
+    float d = t1 * (v + t1 * (a / 2.0 - j * t1 / 6.0));
+    v += t1 * (a - j * t1 / 2.0);
+    // Constant deceleration until the speed is down to that lost bringing it back to 0
+    float v3 = peak * peak / (2.0 * j);
+    if (v > v3)
+	d += (v * v - v3 * v3) / (2.0 * peak);
+    // Back to 0
+    d += peak * peak * peak / (6.0 * j * j);
+    return d;
+}
+
+// As computeNewSpeed(), but for a jerk limited S-curve. Where computeNewSpeed() follows 
+// the speed, this follows the acceleration as well, changing it by no more than the
+// jerk limit times the interval just stepped. The acceleration is held over the next step.
+// Whether to speed up or slow down is decided afresh at each step from the stopping 
+// distance, so errors are corrected as the motor approaches the target.
+void AccelStepper::computeNewSpeedSCurve()
+{
+    long distanceTo = distanceToGo(); // +ve is clockwise from curent location
+
+    if (_n == 0)
+    {
+	if (distanceTo == 0)
+	{
+	    _stepInterval = 0;
+	    _onSchedule = false;
+	    _speed = 0.0;
+	    return;
+	}
+	// First step from stopped. Moving off with the jerk limit the first step
+	// takes cbrt(6 / jerk). Carry on from the slowest speed with no acceleration, 
+	// which can stop again in a step, so that short moves do not overshoot.
+	_cn = _c0Jerk;
+	_accel = 0.0;
+	_speed = 1000000.0 / _cn;
+	_direction = (distanceTo > 0) ? DIRECTION_CW : DIRECTION_CCW;
+	_n++;
+	_stepInterval = _cn;
+	if (_direction == DIRECTION_CCW)
+	    _speed = -_speed;
+	return;
+    }
+
+    float v = fabs(_speed);
+    float stopDistance = sCurveStopDistance(v, _accel);
+
+    if (distanceTo == 0 && stopDistance <= 1.0)
+    {
+	// We are at the target and its time to stop
+	_stepInterval = 0;
+	_onSchedule = false;
+	_speed = 0.0;
+	_accel = 0.0;
+	_n = 0;
+	return;
+    }
+
+    float dt = _cn / 1000000.0;
+    float da = _jerk * dt; // Most the acceleration can change by since the last step
+    float distance = labs(distanceTo);
+    boolean towards = (distanceTo > 0) == (_direction == DIRECTION_CW);
+
+    // Take the highest acceleration of speeding up more or holding that can still
+    // stop at the target and ease into max speed. Otherwise slow down more.
+    float accel = max(_accel - da, -_acceleration);
+    if (towards)
+    {
+	float choices[2] = { min(_accel + da, _acceleration), _accel };
+	for (uint8_t i = 0; i < 2; i++)
+	{
+	    float a = choices[i];
+	    if (a > 0 && v + a * a / (2.0 * _jerk) > _maxSpeed)
+		continue;
+	    if (sCurveStopDistance(v, a) < distance)
+	    {
+		accel = a;
+		break;
+	    }
+	}
+    }
+    _accel = accel;
+
+    // Speed at the next step, from v^2 = u^2 + 2as with s one step.
+    // No slower than the slowest speed, so that the motor still gets to the target
+    float vmin = 1000000.0 / _c0Jerk;
+    float next = v * v + 2.0 * accel;
+    if (next > _maxSpeed * _maxSpeed)
+    {
+	next = _maxSpeed;
+	_accel = 0.0;
+    }
+    else if (next < vmin * vmin)
+    {
+	next = vmin;
+	_accel = 0.0;
+	if (!towards)
+	    _direction = (_direction == DIRECTION_CW) ? DIRECTION_CCW : DIRECTION_CW; // Turn round
+    }
+    else
+	next = sqrt(next);
+
+    // The step takes its length over the mean speed
+    _n++;
+    _cn = 2000000.0 / (v + next);
+    _stepInterval = _cn;
+    v = next;
+    _speed = (_direction == DIRECTION_CCW) ? -v : v;
+}
+#endif
+
+// As computeNewSpeed(), but takes the step intervals from rampTable, so uses no floating point
+void AccelStepper::computeNewSpeedTable()
+{
+    long distanceTo = distanceToGo(); // +ve is clockwise from curent location
+
+    // Accelerating or cruising, we took _n steps to reach this speed, or _stepsToMax 
+    // to reach max speed. So that is how many it takes to stop, per Equation 16.
+    // Decelerating, _n counts up to 0 at the stop.
+    long stepsToStop;
+    if (_n > 0)
+	stepsToStop = min(_n, _stepsToMax);
+    else
+	stepsToStop = -_n;
+
+    if (distanceTo == 0 && stepsToStop <= 1)
+    {
+	// We are at the target and its time to stop
+	_stepInterval = 0;
+	_onSchedule = false;
+	_speed = 0;
+	_n = 0;
+	return;
+    }
+
+    if (distanceTo > 0)
+    {
+	if (_n > 0)
+	{
+	    if ((stepsToStop >= distanceTo) || _direction == DIRECTION_CCW)
+		_n = -stepsToStop; // Start deceleration
+	}
+	else if (_n < 0)
+	{
+	    if ((stepsToStop < distanceTo) && _direction == DIRECTION_CW)
+		_n = -_n; // Start accceleration
+	}
+    }
+    else if (distanceTo < 0)
+    {
+	if (_n > 0)
+	{
+	    if ((stepsToStop >= -distanceTo) || _direction == DIRECTION_CW)
+		_n = -stepsToStop; // Start deceleration
+	}
+	else if (_n < 0)
+	{
+	    if ((stepsToStop < -distanceTo) && _direction == DIRECTION_CCW)
+		_n = -_n; // Start accceleration
+	}
+    }
+
+    if (_n == 0)
+    {
+	// First step from stopped
+	_stepInterval = _c0Interval;
+	_direction = (distanceTo > 0) ? DIRECTION_CW : DIRECTION_CCW;
+    }
+    else
+    {
+	// Equation 13 applied n times from c0 is rampTable[n]. Deceleration with n -ve runs it 
+	// backwards, undoing one step of acceleration each time.
+	_stepInterval = rampInterval(_c0Interval, (_n > 0) ? _n : -_n - 1);
+	_stepInterval = max(_stepInterval, _cminInterval);
+    }
+    _n++;
 }
 
 // Run the motor to implement speed and acceleration in order to proceed to the target position
@@ -186,7 +517,9 @@ boolean AccelStepper::run()
 {
     if (runSpeed())
 	computeNewSpeed();
-    return _speed != 0.0 || distanceToGo() != 0;
+    if (_rampTable)
+	return _stepInterval != 0 || distanceToGo() != 0;
+    return _speed != 0 || distanceToGo() != 0;
 }
 
 AccelStepper::AccelStepper(uint8_t interface, uint8_t pin1, uint8_t pin2, uint8_t pin3, uint8_t pin4, bool enable)
@@ -194,11 +527,11 @@ AccelStepper::AccelStepper(uint8_t interface, uint8_t pin1, uint8_t pin2, uint8_
     _interface = interface;
     _currentPos = 0;
     _targetPos = 0;
-    _speed = 0.0;
-    _maxSpeed = 1.0;
-    _acceleration = 1.0;
-    _sqrt_twoa = 1.0;
+    _speed = 0;
+    _maxSpeed = ACCELSTEPPER_FIXED(1.0);
+    _acceleration = ACCELSTEPPER_FIXED(1.0);
     _stepInterval = 0;
+    _onSchedule = false;
     _minPulseWidth = 1;
     _enablePin = 0xff;
     _lastStepTime = 0;
@@ -209,14 +542,49 @@ AccelStepper::AccelStepper(uint8_t interface, uint8_t pin1, uint8_t pin2, uint8_
 
     // NEW
     _n = 0;
+#ifdef ACCELSTEPPER_FIXED_POINT
+    _rampTable = true; // The only way to ramp in fixed point
+#else
+    _sqrt_twoa = 1.0;
     _c0 = 0.0;
     _cn = 0.0;
     _cmin = 1.0;
+    _jerk = 0.0;
+    _c0Jerk = 0.0;
+    _sCurve = false;
+    _accel = 0.0;
+    _rampTable = false;
+#endif
     _direction = DIRECTION_CCW;
+    _c0Interval = 0;
+    _cminInterval = 1;
+    _stepsToMax = 0;
 
     int i;
     for (i = 0; i < 4; i++)
 	_pinInverted[i] = 0;
+
+    _fastOutputs = false;
+    _nonBlockingPulse = false;
+    _pulseHigh = false;
+    _pulseTime = 0;
+    _pulseRemainder = 0;
+    _dirOutput = 0xff;
+    _dirTime = 0;
+    _dirSetupTime = 0;
+    _timerDirChanged = false;
+    _maxCatchUp = 0;
+    _missedDeadlines = 0;
+    _maxLateness = 0;
+#ifdef ACCELSTEPPER_FAST_GPIO
+    // Look up the port registers once, rather than on every digitalWrite()
+    for (i = 0; i < 4; i++)
+    {
+	_pinOut[i] = portOutputRegister(digitalPinToPort(_pin[i]));
+	_pinMask[i] = digitalPinToBitMask(_pin[i]);
+    }
+#endif
+
     if (enable)
 	enableOutputs();
 }
@@ -226,11 +594,11 @@ AccelStepper::AccelStepper(void (*forward)(), void (*backward)())
     _interface = 0;
     _currentPos = 0;
     _targetPos = 0;
-    _speed = 0.0;
-    _maxSpeed = 1.0;
-    _acceleration = 1.0;
-    _sqrt_twoa = 1.0;
+    _speed = 0;
+    _maxSpeed = ACCELSTEPPER_FIXED(1.0);
+    _acceleration = ACCELSTEPPER_FIXED(1.0);
     _stepInterval = 0;
+    _onSchedule = false;
     _minPulseWidth = 1;
     _enablePin = 0xff;
     _lastStepTime = 0;
@@ -243,26 +611,159 @@ AccelStepper::AccelStepper(void (*forward)(), void (*backward)())
 
     // NEW
     _n = 0;
+#ifdef ACCELSTEPPER_FIXED_POINT
+    _rampTable = true; // The only way to ramp in fixed point
+#else
+    _sqrt_twoa = 1.0;
     _c0 = 0.0;
     _cn = 0.0;
     _cmin = 1.0;
+    _jerk = 0.0;
+    _c0Jerk = 0.0;
+    _sCurve = false;
+    _accel = 0.0;
+    _rampTable = false;
+#endif
     _direction = DIRECTION_CCW;
+    _c0Interval = 0;
+    _cminInterval = 1;
+    _stepsToMax = 0;
 
     int i;
     for (i = 0; i < 4; i++)
 	_pinInverted[i] = 0;
+    _fastOutputs = false;
+    _nonBlockingPulse = false;
+    _pulseHigh = false;
+    _pulseTime = 0;
+    _pulseRemainder = 0;
+    _dirOutput = 0xff;
+    _dirTime = 0;
+    _dirSetupTime = 0;
+    _timerDirChanged = false;
+    _maxCatchUp = 0;
+    _missedDeadlines = 0;
+    _maxLateness = 0;
+}
+
+#ifdef ACCELSTEPPER_FIXED_POINT
+// Integer square root, rounded down
+static unsigned long isqrt(unsigned long x)
+{
+    unsigned long root = 0;
+    unsigned long bit = 1UL << 30;
+    while (bit > x)
+	bit >>= 2;
+    while (bit)
+    {
+	if (x >= root + bit)
+	{
+	    x -= root + bit;
+	    root = (root >> 1) + bit;
+	}
+	else
+	    root >>= 1;
+	bit >>= 2;
+    }
+    return root;
+}
+
+// Steps to stop from speed at the current acceleration, per Equation 16.
+// Whole steps per second only, so that the square fits in 32 bits
+long AccelStepper::stepsToStop(long speed)
+{
+    unsigned long s = labs(speed) >> ACCELSTEPPER_FIXED_SHIFT;
+    unsigned long twoa = (unsigned long)_acceleration >> (ACCELSTEPPER_FIXED_SHIFT - 1);
+    return (s * s) / max(twoa, 1UL);
+}
+
+// The current speed, from the current step interval
+long AccelStepper::currentSpeed()
+{
+    if (!_stepInterval)
+	return 0;
+    long speed = ACCELSTEPPER_FIXED(1000000L) / _stepInterval;
+    return (_direction == DIRECTION_CW) ? speed : -speed;
+}
+
+void AccelStepper::setMaxSpeed(float speed)
+{
+    long maxSpeed = ACCELSTEPPER_FIXED(speed);
+    if (maxSpeed <= 0)
+	return;
+    if (_maxSpeed != maxSpeed)
+    {
+	_maxSpeed = maxSpeed;
+	_cminInterval = ACCELSTEPPER_FIXED(1000000L) / maxSpeed;
+	_stepsToMax = stepsToStop(maxSpeed);
+	// Recompute _n from current speed and adjust speed if accelerating or cruising
+	if (_n > 0)
+	{
+	    _n = stepsToStop(currentSpeed()); // Equation 16
+	    computeNewSpeed();
+	}
+    }
+}
+
+void AccelStepper::setAcceleration(float acceleration)
+{
+    long fixed = ACCELSTEPPER_FIXED(acceleration);
+    if (fixed <= 0)
+	return;
+    if (_acceleration != fixed)
+    {
+	_acceleration = fixed;
+	// Recompute _n per Equation 17, which is the same as Equation 16 at the new acceleration
+	if (_n > 0)
+	    _n = stepsToStop(currentSpeed());
+	else if (_n < 0)
+	    _n = -stepsToStop(currentSpeed());
+	// New c0 per Equation 7, 1000000 / sqrt(acceleration), 
+	// keeping as many bits under the square root as will fit
+	if (fixed < (1L << 23))
+	    _c0Interval = 256000000UL / isqrt((unsigned long)fixed << 8);
+	else
+	    _c0Interval = 16000000UL / isqrt(fixed);
+	_stepsToMax = stepsToStop(_maxSpeed);
+	computeNewSpeed();
+    }
 }
 
+void AccelStepper::setSpeed(float speed)
+{
+    long fixed = ACCELSTEPPER_FIXED(speed);
+    fixed = constrain(fixed, -_maxSpeed, _maxSpeed);
+    if (fixed == 0)
+    {
+	_stepInterval = 0;
+	_onSchedule = false;
+    }
+    else
+    {
+	_stepInterval = ACCELSTEPPER_FIXED(1000000L) / labs(fixed);
+	_direction = (fixed > 0) ? DIRECTION_CW : DIRECTION_CCW;
+    }
+    _speed = fixed;
+}
+
+float AccelStepper::speed()
+{
+    return (float)currentSpeed() / ACCELSTEPPER_FIXED(1);
+}
+#else
 void AccelStepper::setMaxSpeed(float speed)
 {
     if (_maxSpeed != speed)
     {
 	_maxSpeed = speed;
 	_cmin = 1000000.0 / speed;
+	_cminInterval = _cmin;
+	_stepsToMax = (long)((speed * speed) / (2.0 * _acceleration)); // Equation 16
 	// Recompute _n from current speed and adjust speed if accelerating or cruising
 	if (_n > 0)
 	{
-	    _n = (long)((_speed * _speed) / (2.0 * _acceleration)); // Equation 16
+	    float currentSpeed = this->speed();
+	    _n = (long)((currentSpeed * currentSpeed) / (2.0 * _acceleration)); // Equation 16
 	    computeNewSpeed();
 	}
     }
@@ -279,18 +780,31 @@ void AccelStepper::setAcceleration(float acceleration)
 	// New c0 per Equation 7
 //	_c0 = sqrt(2.0 / acceleration) * 1000000.0; // Accelerates too sloly. Why?
 	_c0 = sqrt(1.0/acceleration) * 1000000.0;
+	_c0Interval = _c0;
 	_acceleration = acceleration;
+	_stepsToMax = (long)((_maxSpeed * _maxSpeed) / (2.0 * _acceleration)); // Equation 16
 	computeNewSpeed();
     }
 }
 
+void AccelStepper::setJerk(float jerk)
+{
+    _jerk = jerk;
+    if (jerk > 0.0)
+	_c0Jerk = pow(6.0 / jerk, 1.0 / 3.0) * 1000000.0;
+}
+
 void AccelStepper::setSpeed(float speed)
 {
-    if (speed == _speed)
+    // In ramp table mode _speed is not kept up to date while running
+    if (speed == _speed && !_rampTable)
         return;
     speed = constrain(speed, -_maxSpeed, _maxSpeed);
     if (speed == 0.0)
+    {
 	_stepInterval = 0;
+	_onSchedule = false;
+    }
     else
     {
 	_stepInterval = fabs(1000000.0 / speed);
@@ -301,8 +815,26 @@ void AccelStepper::setSpeed(float speed)
 
 float AccelStepper::speed()
 {
+    if (_rampTable)
+    {
+	// Only worked out on demand, to keep floating point out of computeNewSpeedTable()
+	if (!_stepInterval)
+	    return 0.0;
+	float speed = 1000000.0 / _stepInterval;
+	return (_direction == DIRECTION_CW) ? speed : -speed;
+    }
     return _speed;
 }
+#endif
+
+void AccelStepper::setRampTable(boolean rampTable)
+{
+#ifndef ACCELSTEPPER_FIXED_POINT
+    _rampTable = rampTable;
+#else
+    (void)(rampTable); // Always used
+#endif
+}
 
 // Subclasses can override
 void AccelStepper::step(long step)
@@ -349,6 +881,24 @@ void AccelStepper::setOutputPins(uint8_t mask)
     if (_interface == FULL4WIRE || _interface == HALF4WIRE)
 	numpins = 4;
     uint8_t i;
+#ifdef ACCELSTEPPER_FAST_GPIO
+    if (_fastOutputs)
+    {
+	// Interrupts are held off so that this read-modify-write can't lose a change 
+	// made from an interrupt handler to another pin on the same port
+	uint8_t oldSREG = SREG;
+	cli();
+	for (i = 0; i < numpins; i++)
+	{
+	    if (((mask >> i) & 1) ^ _pinInverted[i])
+		*_pinOut[i] |= _pinMask[i];
+	    else
+		*_pinOut[i] &= ~_pinMask[i];
+	}
+	SREG = oldSREG;
+	return;
+    }
+#endif
     for (i = 0; i < numpins; i++)
 	digitalWrite(_pin[i], (mask & (1 << i)) ? (HIGH ^ _pinInverted[i]) : (LOW ^ _pinInverted[i]));
 }
@@ -356,7 +906,9 @@ void AccelStepper::setOutputPins(uint8_t mask)
 // 0 pin step function (ie for functional usage)
 void AccelStepper::step0(long step)
 {
-  if (_speed > 0)
+    (void)(step); // Unused
+
+  if (_direction == DIRECTION_CW)
     _forward();
   else
     _backward();
@@ -367,6 +919,16 @@ void AccelStepper::step0(long step)
 // Subclasses can override
 void AccelStepper::step1(long step)
 {
+    (void)(step); // Unused
+
+    if (_nonBlockingPulse)
+    {
+	// DIR has already been set up. Lowered by endPulse() or timerStep()
+	setOutputPins(_direction ? 0b11 : 0b01); // step HIGH
+	_pulseHigh = true;
+	return;
+    }
+
     // _pin[0] is step, _pin[1] is direction
     setOutputPins(_direction ? 0b10 : 0b00); // Set direction first else get rogue pulses
     setOutputPins(_direction ? 0b11 : 0b01); // step HIGH
@@ -530,6 +1092,8 @@ void    AccelStepper::disableOutputs()
     if (! _interface) return;
 
     setOutputPins(0); // Handles inversion automatically
+    _pulseHigh = false;
+    _dirOutput = 0xff;
     if (_enablePin != 0xff)
         digitalWrite(_enablePin, LOW ^ _enableInverted);
 }
@@ -554,6 +1118,50 @@ void    AccelStepper::enableOutputs()
     }
 }
 
+void AccelStepper::setFastOutputs(boolean fast)
+{
+#ifdef ACCELSTEPPER_FAST_GPIO
+    _fastOutputs = fast && _interface;
+#endif
+}
+
+void AccelStepper::setNonBlockingPulse(boolean nonBlocking)
+{
+    _nonBlockingPulse = nonBlocking && _interface == DRIVER;
+    _dirOutput = 0xff; // Unknown, so DIR is set before the next step
+}
+
+void AccelStepper::setDirectionSetupTime(unsigned int setupTime)
+{
+    _dirSetupTime = setupTime;
+}
+
+void AccelStepper::setMaxCatchUp(uint8_t maxCatchUp)
+{
+    _maxCatchUp = maxCatchUp;
+}
+
+uint8_t AccelStepper::maxCatchUp()
+{
+    return _maxCatchUp;
+}
+
+unsigned long AccelStepper::missedDeadlines()
+{
+    return _missedDeadlines;
+}
+
+unsigned long AccelStepper::maxLateness()
+{
+    return _maxLateness;
+}
+
+void AccelStepper::resetTimingStats()
+{
+    _missedDeadlines = 0;
+    _maxLateness = 0;
+}
+
 void AccelStepper::setMinPulseWidth(unsigned int minWidth)
 {
     _minPulseWidth = minWidth;
@@ -605,6 +1213,133 @@ boolean AccelStepper::runSpeedToPosition()
     return runSpeed();
 }
 
+unsigned long AccelStepper::timerStep(boolean accelerate)
+{
+    unsigned long remainder;
+    if (endTimerPulse(remainder))
+	return remainder; // Second half of a non-blocking pulse
+
+    if (!_stepInterval)
+	return 0;
+    // At constant speed we stop at the target, as runSpeedToPosition() does
+    if (!accelerate && _targetPos == _currentPos)
+	return 0;
+
+    // Set DIR now and take the step after the setup time
+    if (timerDirection())
+	return max(_dirSetupTime, 1U);
+
+    if (_direction == DIRECTION_CW)
+	_currentPos += 1;
+    else
+	_currentPos -= 1;
+    step(_currentPos);
+
+    unsigned long interval = _stepInterval;
+    if (accelerate)
+    {
+	computeNewSpeed(); // Sets _stepInterval to 0 when stopped at the target
+	interval = _stepInterval;
+    }
+    else if (_targetPos == _currentPos)
+	interval = 0;
+    return timerPulse(interval);
+}
+
+boolean AccelStepper::endTimerPulse(unsigned long& remainder)
+{
+    _timerDirChanged = false;
+    if (!_pulseHigh)
+	return false;
+    setOutputPins(_dirOutput ? 0b10 : 0b00); // step LOW
+    _pulseHigh = false;
+    remainder = _pulseRemainder;
+    return true;
+}
+
+unsigned long AccelStepper::queuedStep(boolean forward, unsigned long interval, boolean& taken)
+{
+    taken = false;
+    _direction = forward ? DIRECTION_CW : DIRECTION_CCW;
+    if (timerDirection())
+	return max(_dirSetupTime, 1U);
+
+    if (forward)
+	_currentPos += 1;
+    else
+	_currentPos -= 1;
+    _targetPos = _currentPos;
+    step(_currentPos);
+    taken = true;
+    return timerPulse(interval);
+}
+
+boolean AccelStepper::timerDirection()
+{
+    _timerDirChanged = _nonBlockingPulse && _direction != _dirOutput;
+    if (_timerDirChanged)
+    {
+	setOutputPins(_direction ? 0b10 : 0b00);
+	_dirOutput = _direction;
+    }
+    return _timerDirChanged;
+}
+
+unsigned long AccelStepper::timerPulse(unsigned long interval)
+{
+    if (!_pulseHigh)
+	return interval;
+    // STEP was left high. Come back to lower it after the pulse width,
+    // then wait out the rest of the interval, but keep STEP low for the pulse width too
+    if (!interval)
+	_pulseRemainder = 0;
+    else if (interval > 2UL * _minPulseWidth)
+	_pulseRemainder = interval - _minPulseWidth;
+    else
+	_pulseRemainder = _minPulseWidth;
+    return max(_minPulseWidth, 1U);
+}
+
+boolean AccelStepper::timerDirChanged()
+{
+    return _timerDirChanged;
+}
+
+// Takes one step now. The target goes with it, so the motor is left stopped
+void AccelStepper::singleStep(boolean forward)
+{
+    if (_nonBlockingPulse)
+    {
+	// Steps closer together than two pulse widths wait, for STEP to be high and then
+	// low for the pulse width
+	unsigned long time = micros();
+	if (_pulseHigh)
+	{
+	    if (time - _pulseTime < _minPulseWidth)
+		delayMicroseconds(_minPulseWidth - (time - _pulseTime));
+	    setOutputPins(_dirOutput ? 0b10 : 0b00); // step LOW
+	    _pulseHigh = false;
+	    _pulseTime = time = micros();
+	}
+	if (time - _pulseTime < _minPulseWidth)
+	    delayMicroseconds(_minPulseWidth - (time - _pulseTime));
+    }
+    _direction = forward ? DIRECTION_CW : DIRECTION_CCW;
+    if (_nonBlockingPulse && _direction != _dirOutput)
+    {
+	setOutputPins(_direction ? 0b10 : 0b00);
+	_dirOutput = _direction;
+	delayMicroseconds(_dirSetupTime);
+    }
+    if (forward)
+	_currentPos += 1;
+    else
+	_currentPos -= 1;
+    _targetPos = _currentPos;
+    step(_currentPos);
+    _pulseTime = micros();
+}
+
 // Blocks until the new target position is reached
 void AccelStepper::runToNewPosition(long position)
 {
@@ -614,10 +1349,22 @@ void AccelStepper::runToNewPosition(long position)
 
 void AccelStepper::stop()
 {
-    if (_speed != 0.0)
+#ifdef ACCELSTEPPER_FIXED_POINT
+    long speed = currentSpeed();
+    if (speed != 0)
+    {    
+	long stepsToStop = this->stepsToStop(speed) + 1; // Equation 16 (+integer rounding)
+#else
+    float speed = this->speed();
+    if (speed != 0.0)
     {    
-	long stepsToStop = (long)((_speed * _speed) / (2.0 * _acceleration)) + 1; // Equation 16 (+integer rounding)
-	if (_speed > 0)
+	long stepsToStop;
+	if (_sCurve)
+	    stepsToStop = (long)sCurveStopDistance(fabs(speed), _accel) + 1;
+	else
+	    stepsToStop = (long)((speed * speed) / (2.0 * _acceleration)) + 1; // Equation 16 (+integer rounding)
+#endif
+	if (speed > 0)
 	    move(stepsToStop);
 	else
 	    move(-stepsToStop);
@@ -199,6 +199,25 @@
 // These defs cause trouble on some versions of Arduino
 #undef round
 
+// Define ACCELSTEPPER_FIXED_POINT (eg in CPPFLAGS) to build the fixed point version of the library.
+// Speeds and accelerations are then held in fixed point with ACCELSTEPPER_FIXED_SHIFT fractional
+// bits, and no floating point is done when stepping.
+#ifdef ACCELSTEPPER_FIXED_POINT
+#define ACCELSTEPPER_FIXED_SHIFT 8
+#define ACCELSTEPPER_FIXED(x) ((long)((x) * (1L << ACCELSTEPPER_FIXED_SHIFT)))
+#else
+#define ACCELSTEPPER_FIXED(x) (x)
+#endif
+
+// Direct port register output is available on AVR, see setFastOutputs()
+#if defined(__AVR__)
+#define ACCELSTEPPER_FAST_GPIO
+#endif
+// The type of a port register, which a simulator can define as its own
+#if defined(ACCELSTEPPER_FAST_GPIO) && !defined(ACCELSTEPPER_PORT)
+#define ACCELSTEPPER_PORT volatile uint8_t
+#endif
+
 /////////////////////////////////////////////////////////////////////
 /// \class AccelStepper AccelStepper.h <AccelStepper.h>
 /// \brief Support for stepper motors with acceleration etc.
@@ -240,6 +259,24 @@
 /// whenever required for the speed set.
 /// Calling setAcceleration() is expensive,
 /// since it requires a square root to be calculated.
+///
+/// \par Fixed point
+/// If ACCELSTEPPER_FIXED_POINT is defined when the library is compiled, speeds and accelerations
+/// are held as fixed point numbers with 8 fractional bits, and setSpeed(), setMaxSpeed(),
+/// setAcceleration(), stop() and the computation of each new speed use only integer arithmetic.
+/// Acceleration always uses the ramp table (see setRampTable()), and the square root in
+/// setAcceleration() is an integer one. The float arguments of the API are converted once, when
+/// they are set. This keeps floating point arithmetic out of the step path and, if the sketch
+/// does not use floating point for anything else, saves the flash the floating point library occupies.
+/// The limits are:
+/// \li Speeds are resolved to 1/256 steps per second, so speeds below 0.004 steps per second are 0.
+/// Step intervals are within 1 microsecond of the floating point version.
+/// \li Speeds must be less than 65536 steps per second and accelerations at least 1 step per 
+/// second per second.
+/// \li Step positions are the same as the floating point version with the ramp table selected. Compared to
+/// Equation 13 in floating point, the intervals are identical for the first 256 steps of each ramp
+/// and within 0.4% after that. Deceleration mirrors acceleration exactly, so a move can take 
+/// a few percent longer to decelerate than with Equation 13, which decelerates sooner from max speed.
 class AccelStepper
 {
 public:
@@ -326,6 +363,33 @@ public:
     /// \return true if the motor was stepped.
     boolean runSpeed();
 
+    /// Sets how runSpeed() and run(), and StepTimer, keep time when they are called late. By default (0) each step
+    /// interval is measured from the time the last step was actually taken, so every late call
+    /// makes the motor run a little slower than the set speed. With catch up, each interval is
+    /// measured from when the last step was due, so the schedule is kept and late steps are
+    /// made up by the following calls. If the motor falls maxCatchUp or more steps behind,
+    /// the backlog is dropped and the schedule restarts from the current time, so a long stall
+    /// can't be followed by a burst of steps faster than the motor can follow.
+    /// Each call still takes at most one step.
+    /// \param[in] maxCatchUp The most steps to catch up, or 0 to not catch up
+    void    setMaxCatchUp(uint8_t maxCatchUp);
+
+    /// \return The most steps to catch up, as set by setMaxCatchUp()
+    uint8_t maxCatchUp();
+
+    /// The number of steps taken by runSpeed() or run() a whole step interval or more after they were due,
+    /// ie too late for the motor to keep to the set speed without catching up. See setMaxCatchUp().
+    /// The first step from stopped is not counted.
+    /// \return The number of missed deadlines since construction or resetTimingStats()
+    unsigned long missedDeadlines();
+
+    /// The longest time between a step being due and runSpeed() or run() taking it.
+    /// \return The worst lateness in microseconds since construction or resetTimingStats()
+    unsigned long maxLateness();
+
+    /// Resets the counts returned by missedDeadlines() and maxLateness()
+    void    resetTimingStats();
+
     /// Sets the maximum permitted speed. The run() function will accelerate
     /// up to the speed set by this function.
     /// \param[in] speed The desired maximum speed in steps per second. Must
@@ -339,6 +403,24 @@ public:
     /// root to be calculated. Dont call more ofthen than needed
     void    setAcceleration(float acceleration);
 
+#ifndef ACCELSTEPPER_FIXED_POINT
+    /// Sets the jerk limit, the rate at which the acceleration may change, and so selects
+    /// the velocity profile run() uses. With no jerk limit the acceleration steps straight
+    /// from 0 to its full value at the start of a move and back at the start of the cruise,
+    /// which can set heavy loads ringing. With a jerk limit the acceleration
+    /// ramps up and down instead, giving an S shaped speed curve. This allows a higher acceleration,
+    /// but each ramp takes longer by about acceleration / jerk seconds.
+    /// The new speed is worked out from the last by a bounded amount of floating point
+    /// arithmetic per step, including up to three square roots, so allow several times the
+    /// cost of Equation 13 and a correspondingly lower maximum step rate.
+    /// The profile is chosen when the motor starts from stopped, so this can be called 
+    /// before each move to select the profile for that move.
+    /// Not available in the fixed point build.
+    /// \param[in] jerk The maximum jerk in steps per second per second per second,
+    /// or 0 (the default) for the usual constant acceleration profile
+    void    setJerk(float jerk);
+#endif
+
     /// Sets the desired constant speed for use with runSpeed().
     /// \param[in] speed The desired constant speed in steps per
     /// second. Positive is clockwise. Speeds of more than 1000 steps per
@@ -351,6 +433,18 @@ public:
     /// \return the most recent speed in steps per second
     float   speed();
 
+    /// Selects how run() computes the step intervals while accelerating and decelerating.
+    /// By default each interval is computed from the last with Equation 13 in floating point,
+    /// which costs several floating point divides per step. With the ramp table the
+    /// intervals are looked up in a precomputed table of Equation 13 and scaled
+    /// by the initial step interval, using only integer arithmetic, so the cost per step is
+    /// much smaller and the maximum step rate correspondingly higher. The intervals are 
+    /// identical to those of Equation 13 for the first 256 steps of a ramp and within 0.4% after that.
+    /// In ramp table mode speed() is computed on demand from the current step interval,
+    /// so it is more expensive to call. The fixed point build always uses the ramp table.
+    /// \param[in] rampTable true to use the ramp table, false (the default) for Equation 13
+    void    setRampTable(boolean rampTable);
+
     /// The distance from the current position to the target position.
     /// \return the distance from the current position to the target position
     /// in steps. Positive is clockwise from the current position.
@@ -385,6 +479,45 @@ public:
     /// \return true if it stepped
     boolean runSpeedToPosition();
 
+    /// Takes the step that is due now, without reference to the clock. This is for use by 
+    /// interrupt driven step generators such as StepTimer, which decide for themselves 
+    /// when each step is due and so do not need runSpeed() to poll micros().
+    /// Safe to call from an interrupt handler.
+    /// \param[in] accelerate If true, a new speed is computed after the step, as run() does.
+    /// If false, the motor steps at the constant speed set by setSpeed() 
+    /// until the target position is reached.
+    /// \return The interval in microseconds from this step to the next one,
+    /// or 0 if there are no more steps to take.
+    unsigned long timerStep(boolean accelerate);
+
+    /// Lowers STEP at the end of a non-blocking pulse left high by timerStep() or queuedStep(),
+    /// for interrupt driven step generators that take steps worked out elsewhere, such as
+    /// StepQueue. Call this before each queuedStep(). Safe to call from an interrupt handler.
+    /// \param[out] remainder Set to the rest of the step interval, in microseconds, if STEP was lowered
+    /// \return true if STEP was lowered, in which case call again after the remainder. 
+    /// A remainder of 0 means that was the last step.
+    boolean endTimerPulse(unsigned long& remainder);
+
+    /// Takes a step worked out elsewhere, such as by StepQueue, as timerStep() does for the steps
+    /// it works out itself. The target position moves with the motor.
+    /// With non-blocking pulses STEP is left high, and the interval returned is the pulse width,
+    /// after which endTimerPulse() lowers it. A change of direction only sets DIR and does not
+    /// take the step: call again with the same step after the interval returned,
+    /// which is the direction setup time. Safe to call from an interrupt handler.
+    /// \param[in] forward true to step towards increasing positions, false to step back
+    /// \param[in] interval The interval in microseconds from this step to the next, or 0 if it is the last
+    /// \param[out] taken Set to true if the step was taken
+    /// \return The interval in microseconds to the next call, or 0 if there are no more steps
+    unsigned long queuedStep(boolean forward, unsigned long interval, boolean& taken);
+
+    /// Whether the last call to timerStep() or queuedStep() only set DIR for a change of direction, so that
+    /// the interval it returned is the direction setup time. DIR is set part way through
+    /// the interrupt handler, some time after the step was due, so the setup time has to be
+    /// counted from when timerStep() returns rather than from the step schedule.
+    /// StepTimer does this.
+    /// \return true if DIR has just been changed
+    boolean timerDirChanged();
+
     /// Moves the motor to the new target position and blocks until it is at
     /// position. Dont use this in event loops, since it blocks.
     /// \param[in] position The new target position.
@@ -394,6 +527,17 @@ public:
     /// to stop as quickly as possible, using to the current speed and acceleration parameters.
     void stop();
 
+    /// Takes one step straight away, without reference to the speed or the clock.
+    /// The target position moves with the motor, so it remains stopped as far as run() and 
+    /// runSpeed() are concerned. This is for use by classes such as StepperGroup
+    /// that decide for themselves when each motor steps.
+    /// With setNonBlockingPulse(), STEP is left high and lowered by the next call to 
+    /// singleStep() or runSpeed(), and a change of direction waits out the direction setup time.
+    /// If the next call comes sooner than the minimum pulse width after either edge, it 
+    /// waits until STEP has been high and then low for the pulse width.
+    /// \param[in] forward true to step towards increasing positions, false to step back
+    void    singleStep(boolean forward);
+
     /// Disable motor pin outputs by setting them all LOW
     /// Depending on the design of your electronics this may turn off
     /// the power to the motor coils, saving power.
@@ -412,6 +556,36 @@ public:
     /// \param[in] minWidth The minimum pulse width in microseconds. 
     void    setMinPulseWidth(unsigned int minWidth);
 
+    /// Selects how step pulses are generated for AccelStepper::DRIVER. By default the step 
+    /// function sets DIR, raises STEP, busy waits for the minimum pulse width and lowers STEP again, 
+    /// all in one go. With non-blocking pulses STEP is raised when the step is taken and lowered 
+    /// by a later call to runSpeed() or run() (or timerStep(), when StepTimer is stepping), once the
+    /// minimum pulse width has passed, so no time is wasted waiting. 
+    /// DIR is set ahead of the step when the direction changes, and the step is held back
+    /// until the direction setup time given to setDirectionSetupTime() has passed. 
+    /// STEP is also held low for at least the minimum pulse width between pulses.
+    /// Pulses are only as accurate as the calls to runSpeed() or run() are frequent, so
+    /// a pulse may be longer than the minimum, but never shorter.
+    /// Has no effect on other interface types.
+    /// \param[in] nonBlocking true for non-blocking pulses, false (default) to busy wait
+    void    setNonBlockingPulse(boolean nonBlocking);
+
+    /// Sets the time the driver requires DIR to be stable before a STEP pulse.
+    /// Only used with non-blocking pulses, see setNonBlockingPulse().
+    /// \param[in] setupTime The direction setup time in microseconds. Defaults to 0.
+    void    setDirectionSetupTime(unsigned int setupTime);
+
+    /// Selects how the motor pins are written. By default each pin is set with digitalWrite(),
+    /// which looks up the pin's port and bit in tables every time, taking several
+    /// microseconds per pin on a 16MHz AVR. With fast outputs the port register and bit mask
+    /// for each pin are looked up once, at construction, and the pins are set by writing the port
+    /// registers directly, which takes well under a microsecond per pin. 
+    /// Unlike digitalWrite(), fast outputs do not turn off PWM on the motor pins,
+    /// so dont use analogWrite() on them. 
+    /// Only available on AVR processors: elsewhere this does nothing and digitalWrite() is always used.
+    /// \param[in] fast true for direct port register writes, false (default) for digitalWrite()
+    void    setFastOutputs(boolean fast);
+
     /// Sets the enable pin number for stepper drivers.
     /// 0xFF indicates unused (default).
     /// Otherwise, if a pin is set, the pin will be turned on when 
@@ -455,6 +629,47 @@ protected:
     /// move() or moveTo()
     void           computeNewSpeed();
 
+    /// Implementation of computeNewSpeed() when the ramp table is selected by setRampTable()
+    void           computeNewSpeedTable();
+
+#ifndef ACCELSTEPPER_FIXED_POINT
+    /// Implementation of computeNewSpeed() for moves with a jerk limit, see setJerk()
+    void           computeNewSpeedSCurve();
+
+    /// The distance to stop within the jerk limit
+    /// \param[in] speed The speed in steps per second, in the direction of travel
+    /// \param[in] acceleration The acceleration. Positive is speeding up
+    /// \return The stopping distance in steps
+    float          sCurveStopDistance(float speed, float acceleration);
+#endif
+
+    /// Lowers STEP at the end of a non-blocking pulse, if it has been high long enough
+    /// \param[in] time The current time in microseconds
+    void           endPulse(unsigned long time);
+
+    /// Whether a non-blocking pulse can start. Sets DIR first if it needs to change.
+    /// \param[in] time The current time in microseconds
+    /// \return true if STEP can be raised now
+    boolean        pulseReady(unsigned long time);
+
+    /// For timerStep() and queuedStep(), sets DIR ahead of a non-blocking pulse if the direction has changed
+    /// \return true if DIR was changed, so the step has to wait for the direction setup time
+    boolean        timerDirection();
+
+    /// For timerStep() and queuedStep(), after a step. If a non-blocking pulse was left high,
+    /// splits the interval into the pulse width and the rest, which endTimerPulse() returns
+    /// \param[in] interval The interval from this step to the next, or 0 if it was the last
+    /// \return The interval to the next call
+    unsigned long  timerPulse(unsigned long interval);
+
+#ifdef ACCELSTEPPER_FIXED_POINT
+    /// Steps needed to stop from a fixed point speed at the current acceleration, per Equation 16
+    long           stepsToStop(long speed);
+
+    /// The current fixed point speed, worked out from the step interval
+    long           currentSpeed();
+#endif
+
     /// Low level function to set the motor output pins
     /// bit 0 of the mask corresponds to _pin[0]
     /// bit 1 of the mask corresponds to _pin[1]
@@ -516,6 +731,21 @@ protected:
     /// \param[in] step The current step phase number (0 to 7)
     virtual void   step8(long step);
 
+    /// Current direction motor is spinning in
+    boolean        _direction; // 1 == CW
+
+    /// Whether the _pins is inverted or not
+    uint8_t        _pinInverted[4];
+
+    /// The minimum allowed pulse width in microseconds
+    unsigned int   _minPulseWidth;
+
+    /// True if STEP is lowered after the step rather than during it, see setNonBlockingPulse()
+    boolean        _nonBlockingPulse;
+
+    /// True while a non-blocking STEP pulse is high
+    boolean        _pulseHigh;
+
 private:
     /// Number of pins on the stepper motor. Permits 2 or 4. 2 pins is a
     /// bipolar, and 4 pins is a unipolar.
@@ -525,9 +755,6 @@ private:
     /// stepper motor or driver
     uint8_t        _pin[4];
 
-    /// Whether the _pins is inverted or not
-    uint8_t        _pinInverted[4];
-
     /// The current absolution position in steps.
     long           _currentPos;    // Steps
 
@@ -536,6 +763,12 @@ private:
     /// max speed, acceleration and deceleration
     long           _targetPos;     // Steps
 
+#ifdef ACCELSTEPPER_FIXED_POINT
+    /// As below, but fixed point
+    long           _speed;
+    long           _maxSpeed;
+    long           _acceleration;
+#else
     /// The current motos speed in steps per second
     /// Positive is clockwise
     float          _speed;         // Steps per second
@@ -547,6 +780,7 @@ private:
     /// per second per second. Must be > 0
     float          _acceleration;
     float          _sqrt_twoa; // Precomputed sqrt(2*_acceleration)
+#endif
 
     /// The current interval between steps in microseconds.
     /// 0 means the motor is currently stopped with _speed == 0
@@ -555,9 +789,6 @@ private:
     /// The last step time in microseconds
     unsigned long  _lastStepTime;
 
-    /// The minimum allowed pulse width in microseconds
-    unsigned int   _minPulseWidth;
-
     /// Is the direction pin inverted?
     ///bool           _dirInverted; /// Moved to _pinInverted[1]
 
@@ -570,6 +801,41 @@ private:
     /// Enable pin for stepper driver, or 0xFF if unused.
     uint8_t        _enablePin;
 
+    /// Time in microseconds of the last edge of a non-blocking pulse
+    unsigned long  _pulseTime;
+
+    /// The rest of the step interval after a non-blocking pulse is lowered by endTimerPulse()
+    unsigned long  _pulseRemainder;
+
+    /// False until the first step from stopped, when the step schedule starts
+    boolean        _onSchedule;
+
+    /// The most steps to catch up, see setMaxCatchUp()
+    uint8_t        _maxCatchUp;
+
+    /// Timing statistics, see missedDeadlines() and maxLateness()
+    unsigned long  _missedDeadlines;
+    unsigned long  _maxLateness;
+
+    /// The direction DIR is currently set to, or 0xff if unknown
+    uint8_t        _dirOutput;
+
+    /// Time in microseconds DIR was last changed, and the time it must be stable before a step
+    unsigned long  _dirTime;
+    unsigned int   _dirSetupTime;
+
+    /// True if the last call to timerStep() or queuedStep() only set DIR, see timerDirChanged()
+    boolean        _timerDirChanged;
+
+    /// True if the motor pins are written directly, see setFastOutputs()
+    boolean        _fastOutputs;
+
+#ifdef ACCELSTEPPER_FAST_GPIO
+    /// Output register and bit mask for each of _pin
+    ACCELSTEPPER_PORT* _pinOut[4];
+    uint8_t        _pinMask[4];
+#endif
+
     /// The pointer to a forward-step procedure
     void (*_forward)();
 
@@ -579,6 +845,7 @@ private:
     /// The step counter for speed calculations
     long _n;
 
+#ifndef ACCELSTEPPER_FIXED_POINT
     /// Initial step size in microseconds
     float _c0;
 
@@ -588,8 +855,28 @@ private:
     /// Min step size in microseconds based on maxSpeed
     float _cmin; // at max speed
 
-    /// Current direction motor is spinning in
-    boolean _direction; // 1 == CW
+    /// Jerk limit set by setJerk(), or 0 for none
+    float _jerk;
+
+    /// First step size in microseconds from stopped with the jerk limit
+    float _c0Jerk;
+
+    /// True if the current move has a jerk limit
+    boolean _sCurve;
+
+    /// Current acceleration of a jerk limited move. Positive is speeding up
+    float _accel;
+#endif
+
+    /// True if step intervals come from the ramp table, see setRampTable()
+    boolean _rampTable;
+
+    /// _c0 and _cmin as integers, for the ramp table
+    unsigned long _c0Interval;
+    unsigned long _cminInterval;
+
+    /// Steps needed to accelerate from rest to _maxSpeed, per Equation 16
+    long _stepsToMax;
 
 };
 
@@ -642,4 +929,35 @@ private:
 /// Shows how to use AccelStepper to control a 3-phase motor, such as a HDD spindle motor
 /// using the Adafruit Motor Shield http://www.ladyada.net/make/mshield/index.html.
 
+/// @example StepTimer.pde
+/// Shows how to step a stepper driver from the Timer1 interrupt with StepTimer,
+/// so that a slow loop() does not disturb the step timing
+
+/// @example RampTable.pde
+/// Compares the cost per step of Equation 13 in floating point with the
+/// integer ramp table selected by setRampTable()
+
+/// @example FastOutputs.pde
+/// Compares the time taken to step a stepper driver with digitalWrite()
+/// against direct port register writes selected by setFastOutputs()
+
+/// @example StaticStepper.pde
+/// Compares the time taken to step a stepper driver with AccelStepper against 
+/// StaticStepper, which has the interface type and pins fixed at compile time
+
+/// @example StepperGroup.pde
+/// Shows how to move two steppers together with StepperGroup, so that they
+/// start and arrive together and move in a straight line in between
+
+/// @example SCurve.pde
+/// Shows how to choose a jerk limited S-curve profile per move with setJerk()
+
+/// @example SegmentPlanner.pde
+/// Shows how to run a path of several segments with SegmentPlanner, without
+/// stopping at the junctions between them
+
+/// @example StepQueue.pde
+/// Shows how to work out the steps in loop() and take them from the Timer1
+/// interrupt with StepQueue, so the interrupt handler only pops and steps
+
 #endif 
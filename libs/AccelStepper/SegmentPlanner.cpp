@@ -0,0 +1,211 @@
+// SegmentPlanner.cpp
+//
+// Copyright (C) 2014 Russell Gower
+// Use is subject to the same license conditions as AccelStepper (GPL V2)
+
+#include "SegmentPlanner.h"
+
+// The consumer may be an interrupt handler, which moves _tail and _count on and reads
+// the planned speeds, so the producer holds interrupts off while it changes them
+#if defined(__AVR__)
+#define SEGMENTPLANNER_LOCK()   uint8_t oldSREG = SREG; cli()
+#define SEGMENTPLANNER_UNLOCK() SREG = oldSREG
+#else
+#define SEGMENTPLANNER_LOCK()
+#define SEGMENTPLANNER_UNLOCK()
+#endif
+
+SegmentPlanner::SegmentPlanner(AccelStepper& stepper)
+    : _stepper(stepper)
+{
+    _tail = 0;
+    _count = 0;
+    _endPosition = 0;
+    _twoA = 2.0;
+    _stepsDone = 0;
+    _speedSq = 0.0;
+    _interval = 0;
+    _lastStepTime = 0;
+}
+
+void SegmentPlanner::setAcceleration(float acceleration)
+{
+    if (acceleration > 0.0)
+	_twoA = 2.0 * acceleration;
+}
+
+boolean SegmentPlanner::full()
+{
+    return _count >= SEGMENTPLANNER_SIZE;
+}
+
+boolean SegmentPlanner::add(long absolute, float speed)
+{
+    if (speed <= 0.0)
+	return false;
+
+    SEGMENTPLANNER_LOCK();
+    uint8_t count = _count;
+    uint8_t head = (_tail + count) % SEGMENTPLANNER_SIZE;
+    if (!count)
+    {
+	// Starting from rest. Stop anything else the stepper was doing
+	_endPosition = _stepper.currentPosition();
+	_stepper.setCurrentPosition(_endPosition);
+	_stepsDone = 0;
+	_speedSq = 0.0;
+    }
+    SEGMENTPLANNER_UNLOCK();
+    if (count >= SEGMENTPLANNER_SIZE)
+	return false;
+    long delta = absolute - _endPosition;
+    if (!delta)
+	return true;
+
+    // The consumer does not look at the new segment until _count includes it
+    Segment* segment = &_segments[head];
+    segment->target = absolute;
+    segment->length = labs(delta);
+    segment->forward = delta > 0;
+    segment->speedSq = speed * speed;
+    segment->entrySq = 0.0;
+    segment->maxEntrySq = 0.0;
+    if (count)
+    {
+	// No faster than either segment at the junction, and stopped to reverse
+	Segment* last = &_segments[prev(head)];
+	if (last->forward == segment->forward)
+	    segment->maxEntrySq = min(last->speedSq, segment->speedSq);
+    }
+    _endPosition = absolute;
+    {
+	SEGMENTPLANNER_LOCK();
+	_count++;
+	SEGMENTPLANNER_UNLOCK();
+    }
+    replan();
+    return true;
+}
+
+// The new segment ends the queue, so has to stop. Working backwards, each entry is raised
+// as far as its junction allows and the motor can still slow to the entry of the segment after.
+// Appending only ever raises entry speeds, so once an entry does not change, none before
+// it will either. Then working forwards from there, each entry is lowered if need be to
+// what the motor can accelerate to from the entry of the segment before.
+// The segment being run is left alone, it has already started.
+// The consumer may move on while this runs, so each entry speed is written with interrupts held
+// off, and the segment being run is only read once at the start. Moving on only makes the
+// replan include a segment that has since started, whose entry speed is no longer used.
+void SegmentPlanner::replan()
+{
+    SEGMENTPLANNER_LOCK();
+    uint8_t tail = _tail;
+    uint8_t head = prev((tail + _count) % SEGMENTPLANNER_SIZE);
+    SEGMENTPLANNER_UNLOCK();
+    uint8_t i = head;
+    float exitSq = 0.0;
+    while (i != tail)
+    {
+	Segment* segment = &_segments[i];
+	float entrySq = min(segment->maxEntrySq, exitSq + _twoA * segment->length);
+	if (entrySq <= segment->entrySq && i != head)
+	    break;
+	setEntry(segment, entrySq);
+	exitSq = entrySq;
+	i = prev(i);
+    }
+
+    for (; i != head; i = next(i))
+    {
+	Segment* segment = &_segments[i];
+	Segment* after = &_segments[next(i)];
+	setEntry(after, min(after->entrySq, segment->entrySq + _twoA * segment->length));
+    }
+}
+
+void SegmentPlanner::setEntry(Segment* segment, float entrySq)
+{
+    SEGMENTPLANNER_LOCK();
+    segment->entrySq = entrySq;
+    SEGMENTPLANNER_UNLOCK();
+}
+
+unsigned long SegmentPlanner::timerStep()
+{
+    unsigned long interval;
+    if (_stepper.endTimerPulse(interval))
+	return interval; // The rest of the interval after the last step
+    if (!_count)
+	return 0;
+
+    // Work out where this step leaves the queue, and the interval to the next, before
+    // taking it. AccelStepper::queuedStep() needs the interval to split a non-blocking
+    // pulse, and if it only sets DIR the step is taken again next time.
+    Segment* segment = &_segments[_tail];
+    uint8_t tail = _tail;
+    uint8_t count = _count;
+    long stepsDone = _stepsDone + 1;
+    float speedSq = _speedSq;
+    if (stepsDone >= segment->length)
+    {
+	// On to the next segment
+	tail = next(tail);
+	count--;
+	stepsDone = 0;
+	if (count && _segments[tail].forward != segment->forward)
+	    speedSq = 0.0; // Reversing, so stopped at the junction
+    }
+
+    interval = 0;
+    if (count)
+    {
+	// As fast as the segment allows, while accelerating from the current speed
+	// and able to slow to the entry of the next segment, or stop
+	Segment* now = &_segments[tail];
+	float exitSq = (count > 1) ? _segments[next(tail)].entrySq : 0.0;
+	speedSq = min(now->speedSq, speedSq + _twoA);
+	speedSq = min(speedSq, exitSq + _twoA * (now->length - stepsDone));
+	interval = 1000000.0 / sqrt(speedSq);
+    }
+    else
+	speedSq = 0.0;
+
+    boolean taken;
+    unsigned long wait = _stepper.queuedStep(segment->forward, interval, taken);
+    if (taken)
+    {
+	_tail = tail;
+	_count = count;
+	_stepsDone = stepsDone;
+	_speedSq = speedSq;
+    }
+    return wait;
+}
+
+boolean SegmentPlanner::run()
+{
+    unsigned long time = micros();
+    if (!_interval)
+    {
+	// Stopped. Start straight away if there is anything queued
+	if (!_count)
+	    return false;
+    }
+    else if (time - _lastStepTime < _interval)
+	return true;
+    _interval = timerStep();
+    // A change of direction counts the setup time from when DIR changed, after time
+    _lastStepTime = _stepper.timerDirChanged() ? micros() : time;
+    return _interval != 0;
+}
+
+void SegmentPlanner::clear()
+{
+    SEGMENTPLANNER_LOCK();
+    _count = 0;
+    _stepsDone = 0;
+    _speedSq = 0.0;
+    _interval = 0;
+    _endPosition = _stepper.currentPosition();
+    SEGMENTPLANNER_UNLOCK();
+}
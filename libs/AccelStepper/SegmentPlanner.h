@@ -0,0 +1,127 @@
+// SegmentPlanner.h
+//
+// Copyright (C) 2014 Russell Gower
+// Use is subject to the same license conditions as AccelStepper (GPL V2)
+
+#ifndef SegmentPlanner_h
+#define SegmentPlanner_h
+
+#include "AccelStepper.h"
+
+/// The most segments a SegmentPlanner can hold, including the one being run
+#define SEGMENTPLANNER_SIZE 8
+
+/////////////////////////////////////////////////////////////////////
+/// \class SegmentPlanner SegmentPlanner.h <SegmentPlanner.h>
+/// \brief Queue of moves run one after another without stopping in between
+///
+/// AccelStepper accelerates from rest to each target position and stops there, so a path
+/// made up of several moves, or a change of speed part way along, stops at every vertex.
+/// SegmentPlanner holds a queue of segments, each a target position and a speed, and runs
+/// them back to back. Looking ahead along the queue, it works out the speed to enter and
+/// leave each segment at so that the motor:
+/// \li never exceeds the speed of either segment at the junction between them
+/// \li stops where the direction reverses, and at the end of the queue
+/// \li can always slow down in time for what is queued after, at the set acceleration
+///
+/// So the motor only slows down at a junction if it has to, and only as much as it has to.
+/// Segments can be added while the queue is running, as long as there is room. Adding a
+/// segment replans only the segments whose speeds it changes, working back from the new
+/// segment until the speeds stop changing, and then forwards to the end.
+/// The queue is a fixed size ring buffer, there is no dynamic memory allocation.
+///
+/// Speeds and accelerations are kept squared, so planning needs no square roots.
+/// Running takes one square root and one divide per step.
+///
+/// While the planner is running, it owns the stepper: dont call the stepper's
+/// run(), runSpeed() or move functions.
+class SegmentPlanner
+{
+public:
+    /// Constructor
+    /// \param[in] stepper The stepper to run the segments on
+    SegmentPlanner(AccelStepper& stepper);
+
+    /// Sets the acceleration and deceleration used within and between segments.
+    /// Takes effect for segments added afterwards.
+    /// \param[in] acceleration The acceleration in steps per second per second. Must be > 0.
+    void    setAcceleration(float acceleration);
+
+    /// Adds a segment to the end of the queue. A segment to where the queue already
+    /// ends does nothing. Can be called while timerStep() is being called from an
+    /// interrupt handler.
+    /// \param[in] absolute The target position of the segment
+    /// \param[in] speed The speed to move along it at, in steps per second. Must be > 0.
+    /// \return false if the queue is full or the speed is not > 0, in which case the
+    /// segment is not added.
+    boolean add(long absolute, float speed);
+
+    /// \return true if there is no room to add() another segment
+    boolean full();
+
+    /// Polls the planner and steps the motor if a step is due.
+    /// Call this as frequently as possible.
+    /// \return true while there are segments left to run
+    boolean run();
+
+    /// Takes the step that is due now, without reference to the clock, for
+    /// interrupt driven step generators. See AccelStepper::timerStep().
+    /// With non-blocking pulses, a call may instead lower STEP or set DIR for a change
+    /// of direction, see AccelStepper::queuedStep().
+    /// \return The interval in microseconds to the next call,
+    /// or 0 if there are no more steps to take.
+    unsigned long timerStep();
+
+    /// Drops all the queued segments, stopping the motor immediately, wherever it is.
+    void    clear();
+
+private:
+    /// One queued move. Speeds are squared, in steps per second squared
+    typedef struct
+    {
+	long    target;     ///< Position at the end of the segment
+	long    length;     ///< Steps from the start of the segment to the end
+	boolean forward;    ///< True if the position increases along the segment
+	float   speedSq;    ///< Speed along the segment
+	float   maxEntrySq; ///< Fastest allowed at the junction into the segment
+	float   entrySq;    ///< Planned speed at the start of the segment
+    } Segment;
+
+    /// Index of the segment after i in the ring buffer
+    static uint8_t next(uint8_t i) { return (i + 1) % SEGMENTPLANNER_SIZE; }
+
+    /// Index of the segment before i in the ring buffer
+    static uint8_t prev(uint8_t i) { return (i + SEGMENTPLANNER_SIZE - 1) % SEGMENTPLANNER_SIZE; }
+
+    /// Works out the new entry speeds after a segment is added
+    void          replan();
+
+    /// Sets the entry speed of a segment, which the consumer may be reading
+    void          setEntry(Segment* segment, float entrySq);
+
+    /// The stepper being driven
+    AccelStepper& _stepper;
+
+    /// The queue. _tail is the segment being run, _count the number queued
+    Segment       _segments[SEGMENTPLANNER_SIZE];
+    volatile uint8_t _tail;
+    volatile uint8_t _count;
+
+    /// Position at the end of the last segment queued
+    long          _endPosition;
+
+    /// Twice the acceleration, as it is used in v^2 = u^2 + 2as
+    float         _twoA;
+
+    /// Steps taken along the segment being run
+    long          _stepsDone;
+
+    /// Current speed squared
+    float         _speedSq;
+
+    /// For run(), the interval to the next step, 0 when stopped, and the time of the last one
+    unsigned long _interval;
+    unsigned long _lastStepTime;
+};
+
+#endif
@@ -0,0 +1,146 @@
+// StaticStepper.h
+//
+// Copyright (C) 2014 Russell Gower
+// Use is subject to the same license conditions as AccelStepper (GPL V2)
+
+#ifndef StaticStepper_h
+#define StaticStepper_h
+
+#include "AccelStepper.h"
+
+// On the ATmega168/328 (Uno etc) the port and bit of each Arduino pin number
+// are fixed, so they can be worked out at compile time
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) || defined(__AVR_ATmega168__)
+#define STATICSTEPPER_STATIC_PINS
+#endif
+
+/////////////////////////////////////////////////////////////////////
+/// \class StaticStepper StaticStepper.h <StaticStepper.h>
+/// \brief AccelStepper with the motor interface and pins fixed at compile time
+///
+/// AccelStepper decides how to drive the motor at run time: step() switches on the interface type,
+/// calls one of the virtual step1() to step8(), which switches again on the step phase and calls
+/// setOutputPins(), which loops over the pins. StaticStepper takes the interface type and pin numbers
+/// as template arguments instead, so all of that is resolved by the compiler and step() compiles down
+/// to a handful of pin writes. On the ATmega168/328 the pins are written with single
+/// instructions to the port registers, elsewhere by setOutputPins().
+///
+/// It is a subclass rather than a templated core: AccelStepper still reaches step() with one
+/// virtual call per step, from runSpeed(), timerStep() and so on, so that a StaticStepper
+/// can be used anywhere an AccelStepper can, such as with StepTimer. What it saves is
+/// everything below that call. Everything else, including speed and acceleration, is AccelStepper.
+/// host/bench.cpp measures it against AccelStepper with stepbench -p, and
+/// examples/StaticStepper does on the board.
+/// 
+/// \code
+/// StaticStepper<AccelStepper::DRIVER, 2, 3> stepper; // Step on 2, direction on 3
+/// \endcode
+///
+/// AccelStepper::FUNCTION is not supported, use AccelStepper(forward, backward) for that.
+/// setPinsInverted() works as usual, setFastOutputs() makes no difference where the pins are static.
+template <uint8_t Interface, uint8_t Pin1 = 2, uint8_t Pin2 = 3, uint8_t Pin3 = 4, uint8_t Pin4 = 5>
+class StaticStepper : public AccelStepper
+{
+public:
+    /// Constructor.
+    /// \param[in] enable If this is true (the default), enableOutputs() will be called to enable
+    /// the output pins at construction time.
+    StaticStepper(bool enable = true)
+	: AccelStepper(Interface, Pin1, Pin2, Pin3, Pin4, enable)
+    {
+    }
+
+protected:
+    /// Executes a step, with the interface and pins resolved at compile time
+    /// \param[in] step The current step number
+    virtual void step(long step)
+    {
+	if (Interface == DRIVER && _nonBlockingPulse)
+	{
+	    // As AccelStepper::step1(). DIR is already set up, STEP is lowered later
+	    writePins(_direction ? 0b11 : 0b01); // step HIGH
+	    _pulseHigh = true;
+	}
+	else if (Interface == DRIVER)
+	{
+	    // As AccelStepper::step1()
+	    writePins(_direction ? 0b10 : 0b00); // Set direction first else get rogue pulses
+	    writePins(_direction ? 0b11 : 0b01); // step HIGH
+	    delayMicroseconds(_minPulseWidth);
+	    writePins(_direction ? 0b10 : 0b00); // step LOW
+	}
+	else
+	    writePins(phase(step));
+    }
+
+    /// Sets the motor pins for the rest of AccelStepper, eg disableOutputs() 
+    /// and the end of non-blocking pulses
+    /// \param[in] mask bit 0 for Pin1 and so on
+    virtual void setOutputPins(uint8_t mask)
+    {
+	writePins(mask);
+    }
+
+private:
+    /// Output pin mask for each step, in the same order as AccelStepper::step2() to step8()
+    static uint8_t phase(long step)
+    {
+	static const uint8_t full2wire[4] = { 0b10, 0b11, 0b01, 0b00 };
+	static const uint8_t full3wire[3] = { 0b100, 0b001, 0b010 };
+	static const uint8_t full4wire[4] = { 0b0101, 0b0110, 0b1010, 0b1001 };
+	static const uint8_t half3wire[6] = { 0b100, 0b101, 0b001, 0b011, 0b010, 0b110 };
+	static const uint8_t half4wire[8] = { 0b0001, 0b0101, 0b0100, 0b0110, 0b0010, 0b1010, 0b1000, 0b1001 };
+
+	switch (Interface)
+	{
+	    case FULL2WIRE: return full2wire[step & 0x3];
+	    case FULL3WIRE: return full3wire[step % 3];
+	    case FULL4WIRE: return full4wire[step & 0x3];
+	    case HALF3WIRE: return half3wire[step % 6];
+	    case HALF4WIRE: return half4wire[step & 0x7];
+	}
+	return 0;
+    }
+
+    /// Sets the motor pins from a mask, bit 0 for Pin1 and so on
+    void writePins(uint8_t mask)
+    {
+#ifdef STATICSTEPPER_STATIC_PINS
+	writePin<Pin1>(0, mask & 0x1);
+	writePin<Pin2>(1, mask & 0x2);
+	if (Interface != DRIVER && Interface != FULL2WIRE)
+	    writePin<Pin3>(2, mask & 0x4);
+	if (Interface == FULL4WIRE || Interface == HALF4WIRE)
+	    writePin<Pin4>(3, mask & 0x8);
+#else
+	AccelStepper::setOutputPins(mask);
+#endif
+    }
+
+#ifdef STATICSTEPPER_STATIC_PINS
+    /// Sets one motor pin, allowing for inversion
+    /// \param[in] index Which of the motor pins Pin is, for setPinsInverted()
+    /// \param[in] level Non-zero for HIGH
+    template <uint8_t Pin>
+    void writePin(uint8_t index, uint8_t level)
+    {
+	level = (level != 0) ^ _pinInverted[index];
+	// Constant port and bit, so these are single sbi/cbi instructions, 
+	// which can't be upset by interrupts
+	if (Pin < 8)
+	{
+	    if (level) PORTD |= _BV(Pin & 7); else PORTD &= ~_BV(Pin & 7);
+	}
+	else if (Pin < 14)
+	{
+	    if (level) PORTB |= _BV((Pin - 8) & 7); else PORTB &= ~_BV((Pin - 8) & 7);
+	}
+	else
+	{
+	    if (level) PORTC |= _BV((Pin - 14) & 7); else PORTC &= ~_BV((Pin - 14) & 7);
+	}
+    }
+#endif
+};
+
+#endif 
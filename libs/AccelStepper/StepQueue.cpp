@@ -0,0 +1,149 @@
+// StepQueue.cpp
+//
+// Copyright (C) 2014 Russell Gower
+// Use is subject to the same license conditions as AccelStepper (GPL V2)
+
+#include "StepQueue.h"
+
+// Index mask, and the bit of an entry that holds the direction
+#define STEPQUEUE_MASK    (STEPQUEUE_SIZE - 1)
+#define STEPQUEUE_FORWARD 0x80000000UL
+
+StepQueue::StepQueue()
+{
+    _head = 0;
+    _tail = 0;
+    _underrun = false;
+    _underruns = 0;
+    _minDepth = STEPQUEUE_SIZE;
+    _interval = 0;
+    _lastStepTime = 0;
+}
+
+boolean StepQueue::full()
+{
+    return (uint8_t)(_head - _tail) >= STEPQUEUE_SIZE;
+}
+
+uint8_t StepQueue::depth()
+{
+    return _head - _tail;
+}
+
+boolean StepQueue::push(unsigned long interval, boolean forward)
+{
+    if (full())
+	return false;
+    uint8_t head = _head;
+    _entries[head & STEPQUEUE_MASK] = forward ? (interval | STEPQUEUE_FORWARD) : interval;
+    _head = head + 1; // Only now can the consumer see it
+    return true;
+}
+
+uint8_t StepQueue::fill(AccelStepper& profile, boolean accelerate)
+{
+    uint8_t added = 0;
+    while (!full())
+    {
+	long position = profile.currentPosition();
+	unsigned long interval = profile.timerStep(accelerate);
+	long moved = profile.currentPosition() - position;
+	if (!moved)
+	    break; // Already at the end of the run
+	push(interval, moved > 0);
+	added++;
+	if (!interval)
+	    break;
+    }
+    return added;
+}
+
+unsigned long StepQueue::timerStep(AccelStepper& stepper)
+{
+    unsigned long interval;
+    if (stepper.endTimerPulse(interval))
+	return interval; // The rest of the interval after the last step
+
+    uint8_t tail = _tail;
+    if (tail == _head)
+    {
+	// The producer has fallen behind
+	if (!_underrun)
+	{
+	    _underrun = true;
+	    _underruns++;
+	}
+	return STEPQUEUE_RETRY;
+    }
+    _underrun = false;
+
+    // Left in the queue if it only sets DIR, to be taken after the direction setup time
+    unsigned long entry = _entries[tail & STEPQUEUE_MASK];
+    boolean taken;
+    interval = stepper.queuedStep(entry & STEPQUEUE_FORWARD, entry & ~STEPQUEUE_FORWARD, taken);
+    if (taken)
+    {
+	_tail = ++tail; // Now the producer can reuse it
+	uint8_t depth = _head - tail;
+	if (depth < _minDepth)
+	    _minDepth = depth;
+    }
+    return interval;
+}
+
+boolean StepQueue::run(AccelStepper& stepper)
+{
+    unsigned long time = micros();
+    if (!_interval)
+    {
+	// Stopped. Start straight away if there is anything queued
+	if (_tail == _head)
+	    return false;
+    }
+    else if (time - _lastStepTime < _interval)
+	return true;
+    _interval = timerStep(stepper);
+    // A change of direction counts the setup time from when DIR changed, after time
+    _lastStepTime = stepper.timerDirChanged() ? micros() : time;
+    return _interval != 0;
+}
+
+unsigned long StepQueue::underruns()
+{
+    unsigned long count;
+#if defined(__AVR__)
+    // The consumer may be an interrupt handler, and this takes more than one read
+    uint8_t oldSREG = SREG;
+    cli();
+    count = _underruns;
+    SREG = oldSREG;
+#else
+    count = _underruns;
+#endif
+    return count;
+}
+
+uint8_t StepQueue::minDepth()
+{
+    return _minDepth;
+}
+
+void StepQueue::resetStats()
+{
+#if defined(__AVR__)
+    uint8_t oldSREG = SREG;
+    cli();
+#endif
+    _underruns = 0;
+    _minDepth = STEPQUEUE_SIZE;
+#if defined(__AVR__)
+    SREG = oldSREG;
+#endif
+}
+
+void StepQueue::clear()
+{
+    _head = _tail;
+    _underrun = false;
+    _interval = 0;
+}
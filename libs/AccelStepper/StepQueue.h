@@ -0,0 +1,120 @@
+// StepQueue.h
+//
+// Copyright (C) 2014 Russell Gower
+// Use is subject to the same license conditions as AccelStepper (GPL V2)
+
+#ifndef StepQueue_h
+#define StepQueue_h
+
+#include "AccelStepper.h"
+
+/// Number of steps the queue holds. Must be a power of 2, no more than 128
+#define STEPQUEUE_SIZE 32
+
+/// Interval in microseconds before the consumer looks again when the queue is empty
+#define STEPQUEUE_RETRY 100
+
+/////////////////////////////////////////////////////////////////////
+/// \class StepQueue StepQueue.h <StepQueue.h>
+/// \brief Queue of precomputed steps, to keep the speed calculations off the step deadlines
+///
+/// AccelStepper works out the interval to the next step straight after taking each step,
+/// so however fast that calculation is, it is done against the clock. StepQueue splits
+/// the work in two. The producer, in loop(), works the intervals out ahead of time and
+/// pushes them onto the queue with the direction of each step. The consumer, in the StepTimer
+/// interrupt handler or polled with run(), only pops each step off and takes it, so the cost
+/// per step is a load and a pin write, and the heavy maths can take as long as
+/// it likes provided it keeps the queue topped up on average.
+///
+/// The queue is a fixed size ring buffer with one producer and one consumer. Each
+/// side only writes its own index, so no locking is needed, and the producer
+/// never has to hold interrupts off.
+///
+/// Each entry is the direction of a step and the interval in microseconds from that step
+/// to the next, as returned by AccelStepper::timerStep(). An interval of 0 ends the run.
+/// If the consumer finds the queue empty before that, the producer has fallen behind:
+/// this is counted as an underrun, and the consumer looks again after STEPQUEUE_RETRY microseconds.
+///
+/// The usual producer is fill(), which takes the steps from an AccelStepper used only to
+/// work out the profile. Create it with the FUNCTION interface and functions that do
+/// nothing, so that its steps have no outputs. The consumer takes the steps with
+/// AccelStepper::queuedStep() on the stepper that drives the motor, which ends non-blocking
+/// pulses and waits out the direction setup time from the timer as StepTimer does for its own steps.
+class StepQueue
+{
+public:
+    /// Constructor. The queue starts empty
+    StepQueue();
+
+    /// Adds a step to the queue. Producer only.
+    /// \param[in] interval The interval in microseconds from this step to the next,
+    /// or 0 if it is the last step
+    /// \param[in] forward true to step towards increasing positions, false to step back
+    /// \return false if the queue is full, in which case the step is not added
+    boolean push(unsigned long interval, boolean forward);
+
+    /// Tops up the queue with the next steps of a profile. Producer only.
+    /// \param[in] profile An AccelStepper with the FUNCTION interface, set up with the
+    /// speed, acceleration and target position to run to. Its steps are taken with
+    /// AccelStepper::timerStep()
+    /// \param[in] accelerate Passed to AccelStepper::timerStep()
+    /// \return The number of steps added
+    uint8_t fill(AccelStepper& profile, boolean accelerate);
+
+    /// \return true if there is no room to add another step
+    boolean full();
+
+    /// \return The number of steps in the queue
+    uint8_t depth();
+
+    /// Takes the step at the front of the queue. Consumer only, and called by StepTimer
+    /// when it is started with a StepQueue. With non-blocking pulses, a call may instead
+    /// lower STEP or set DIR for a change of direction, see AccelStepper::queuedStep().
+    /// \param[in] stepper The stepper to take the step on
+    /// \return The interval in microseconds to the next call, or 0 at the end of the run
+    unsigned long timerStep(AccelStepper& stepper);
+
+    /// Polls the queue and takes the step at the front if it is due. Consumer only,
+    /// for when the steps are not taken from StepTimer.
+    /// \param[in] stepper The stepper to take the step on
+    /// \return true while running
+    boolean run(AccelStepper& stepper);
+
+    /// The number of times the consumer found the queue empty before the end of the run,
+    /// so that the next step was late
+    /// \return The number of underruns since the last resetStats()
+    unsigned long underruns();
+
+    /// The fewest steps left in the queue after a step was taken. Close to 0 means
+    /// the producer is only just keeping up
+    /// \return The least depth since the last resetStats()
+    uint8_t minDepth();
+
+    /// Resets the counts returned by underruns() and minDepth()
+    void    resetStats();
+
+    /// Empties the queue. Only call this while the consumer is stopped.
+    void    clear();
+
+private:
+    /// The steps. Bit 31 is set for a step forward, the rest is the interval
+    volatile unsigned long _entries[STEPQUEUE_SIZE];
+
+    /// Free running indices, masked to index _entries. _head is only written by the
+    /// producer, _tail only by the consumer
+    volatile uint8_t       _head;
+    volatile uint8_t       _tail;
+
+    /// True while the queue is empty before the end of the run
+    boolean                _underrun;
+
+    /// Statistics, see underruns() and minDepth()
+    volatile unsigned long _underruns;
+    volatile uint8_t       _minDepth;
+
+    /// For run(), the interval to the next step, 0 when stopped, and the time of the last one
+    unsigned long          _interval;
+    unsigned long          _lastStepTime;
+};
+
+#endif
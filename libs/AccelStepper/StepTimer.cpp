@@ -0,0 +1,190 @@
+// StepTimer.cpp
+//
+// Copyright (C) 2014 Russell Gower
+// Use is subject to the same license conditions as AccelStepper (GPL V2)
+
+#include "StepTimer.h"
+
+#ifdef STEPTIMER_SUPPORTED
+#include <avr/interrupt.h>
+
+// Longest single compare interval. Keeping this to half the timer period means a
+// compare point that has already passed can always be recognised.
+#define STEPTIMER_MAX_CHUNK 0x4000
+
+// Intervals shorter than this are shorter than the interrupt handler itself, such as the
+// end of a non-blocking STEP pulse. They mean as soon as possible, so are not counted as missed.
+#define STEPTIMER_ASAP 32
+
+AccelStepper* volatile StepTimer::_stepper = 0;
+StepQueue* volatile    StepTimer::_queue = 0;
+volatile boolean       StepTimer::_accelerate = false;
+volatile boolean       StepTimer::_running = false;
+void (* volatile       StepTimer::_onStop)() = 0;
+unsigned long          StepTimer::_remaining = 0;
+uint16_t               StepTimer::_due = 0;
+volatile unsigned long StepTimer::_missedDeadlines = 0;
+volatile uint16_t      StepTimer::_maxLatency = 0;
+
+void StepTimer::begin(AccelStepper* stepper, boolean accelerate)
+{
+    end();
+    _stepper = stepper;
+    _queue = 0;
+    _accelerate = accelerate;
+    start();
+}
+
+// Steps are then taken from the queue rather than worked out in the interrupt handler
+void StepTimer::begin(StepQueue* queue, AccelStepper* stepper)
+{
+    end();
+    _stepper = stepper;
+    _queue = queue;
+    _accelerate = false;
+    start();
+}
+
+void StepTimer::start()
+{
+    _remaining = 0;
+    _running = true;
+
+    uint8_t oldSREG = SREG;
+    cli();
+    TCCR1A = 0;          // Normal mode, free running, no output compare pins
+    TCCR1B = _BV(CS11);  // clk/8
+    OCR1A = TCNT1 + 16;  // First step straight away
+    _due = OCR1A;
+    TIFR1 = _BV(OCF1A);  // Discard any stale compare match
+    TIMSK1 |= _BV(OCIE1A);
+    SREG = oldSREG;
+}
+
+void StepTimer::end()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    TIMSK1 &= ~_BV(OCIE1A);
+    _running = false;
+    SREG = oldSREG;
+}
+
+boolean StepTimer::running()
+{
+    return _running;
+}
+
+void StepTimer::onStop(void (*handler)())
+{
+    _onStop = handler;
+}
+
+unsigned long StepTimer::missedDeadlines()
+{
+    unsigned long missed;
+    uint8_t oldSREG = SREG;
+    cli();
+    missed = _missedDeadlines;
+    SREG = oldSREG;
+    return missed;
+}
+
+unsigned int StepTimer::maxLatency()
+{
+    unsigned int latency;
+    uint8_t oldSREG = SREG;
+    cli();
+    latency = _maxLatency;
+    SREG = oldSREG;
+    return latency / STEPTIMER_TICKS_PER_US;
+}
+
+void StepTimer::resetStats()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    _missedDeadlines = 0;
+    _maxLatency = 0;
+    SREG = oldSREG;
+}
+
+unsigned int StepTimer::slack()
+{
+    int16_t ahead;
+    if (!_running)
+	return 0xffff;
+    uint8_t oldSREG = SREG;
+    cli();
+    ahead = OCR1A - TCNT1;
+    SREG = oldSREG;
+    return (ahead > 0) ? ahead / STEPTIMER_TICKS_PER_US : 0;
+}
+
+void StepTimer::schedule(unsigned long ticks)
+{
+    uint16_t chunk = (ticks > STEPTIMER_MAX_CHUNK) ? STEPTIMER_MAX_CHUNK : ticks;
+    _remaining = ticks - chunk;
+    _due += chunk;
+    OCR1A = _due;
+    // If the step took longer than the interval the compare point is already behind
+    // us, and would not match again until the timer wraps
+    int16_t ahead = _due - TCNT1;
+    if (ahead > 0)
+	return;
+    if (ticks >= STEPTIMER_ASAP)
+    {
+	_missedDeadlines++;
+	// Too many steps behind to catch up, or too far behind to tell. Start the schedule
+	// again from the step just taken, as runSpeed() does
+	if (ahead < -STEPTIMER_MAX_CHUNK || (unsigned long)-ahead >= _stepper->maxCatchUp() * ticks)
+	{
+	    _due = TCNT1 + chunk;
+	    OCR1A = _due;
+	    return;
+	}
+    }
+    // Step as soon as possible, but leave _due on the schedule so the time is made up by
+    // the intervals that follow. Intervals this short are such as the end of a pulse
+    OCR1A = TCNT1 + 4;
+}
+
+void StepTimer::isr()
+{
+    if (_remaining)
+    {
+	// Still counting out an interval longer than the timer period
+	schedule(_remaining);
+	return;
+    }
+
+    // How long after the step was due we got here. OCR1A is later than that if it was missed
+    uint16_t latency = TCNT1 - _due;
+    if (latency > _maxLatency)
+	_maxLatency = latency;
+
+    unsigned long interval;
+    if (_queue)
+	interval = _queue->timerStep(*_stepper);
+    else
+	interval = _stepper->timerStep(_accelerate);
+    if (_stepper->timerDirChanged())
+	_due = TCNT1; // Count the direction setup time from now, DIR was set after the step was due
+    if (!interval)
+    {
+	// At the target position
+	TIMSK1 &= ~_BV(OCIE1A);
+	_running = false;
+	if (_onStop)
+	    _onStop();
+	return;
+    }
+    schedule(interval * STEPTIMER_TICKS_PER_US);
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+    StepTimer::isr();
+}
+
+#endif
@@ -0,0 +1,125 @@
+// StepTimer.h
+//
+// Copyright (C) 2014 Russell Gower
+// Use is subject to the same license conditions as AccelStepper (GPL V2)
+
+#ifndef StepTimer_h
+#define StepTimer_h
+
+#include "AccelStepper.h"
+#include "StepQueue.h"
+
+#if defined(__AVR__)
+#define STEPTIMER_SUPPORTED
+#endif
+
+#ifdef STEPTIMER_SUPPORTED
+
+/// Timer1 runs at F_CPU/8, which is 2 ticks per microsecond on a 16MHz Uno
+#define STEPTIMER_TICKS_PER_US (F_CPU / 8000000UL)
+
+/////////////////////////////////////////////////////////////////////
+/// \class StepTimer StepTimer.h <StepTimer.h>
+/// \brief Interrupt driven step generation for a single AccelStepper
+///
+/// Polling with AccelStepper::runSpeed() or run() only steps the motor when your loop
+/// gets round to calling it, so anything slow in the loop (analogRead(), LCD updates
+/// etc) shows up as jitter in the step timing.
+///
+/// StepTimer instead takes each step from the Timer1 output compare A interrupt.
+/// Timer1 is left free running and each compare point is set relative to the
+/// previous one, not to the time the interrupt was serviced, so the step edges fall on
+/// the ideal schedule given by the step interval regardless of what the foreground
+/// is doing. The remaining jitter is the latency of the interrupt itself, which is a few
+/// microseconds at most, set by other interrupt handlers such as the one behind millis().
+///
+/// Intervals longer than the timer period are counted out in chunks, so very slow speeds
+/// are supported as well.
+///
+/// Only one stepper can be driven at a time. While StepTimer is running the stepper
+/// belongs to the interrupt handler: dont call its run() or runSpeed() functions, and 
+/// read its position inside an ATOMIC_BLOCK or after end().
+/// Timer1 is reconfigured by begin(), so PWM on pins 9 and 10 is not available
+/// while StepTimer is in use.
+class StepTimer
+{
+public:
+    /// Starts stepping the motor from the timer interrupt. The first step is taken
+    /// straight away and following steps are spaced by the stepper's step interval.
+    /// Stepping stops by itself when the stepper reaches its target position.
+    /// \param[in] stepper The stepper to drive. Set its speed and target position first.
+    /// \param[in] accelerate If true, accelerate and decelerate as AccelStepper::run() does.
+    /// If false, step at the constant speed set by AccelStepper::setSpeed()
+    static void    begin(AccelStepper* stepper, boolean accelerate = false);
+
+    /// Starts taking steps from a StepQueue, so that the interrupt handler only pops each 
+    /// step and takes it. The first step is taken straight away and stepping stops by itself
+    /// at the end of the run, see StepQueue.
+    /// \param[in] queue The queue to take the steps from. Fill it first.
+    /// \param[in] stepper The stepper that drives the motor
+    static void    begin(StepQueue* queue, AccelStepper* stepper);
+
+    /// Stops stepping immediately, wherever the motor is.
+    static void    end();
+
+    /// \return true while the motor is being stepped from the interrupt
+    static boolean running();
+
+    /// Sets a function to be called when stepping stops by itself at the target position,
+    /// but not when end() is called. It is called from the interrupt handler as soon as
+    /// the motor has arrived, so other work can be timed from the end of a move.
+    /// \param[in] handler The function to call, or 0 for none. Keep it short.
+    static void    onStop(void (*handler)());
+
+    /// The number of times stepping fell behind the schedule, because the time taken to step and compute 
+    /// the next interval was longer than the interval itself, or interrupts were held off. Each time, the
+    /// next step is taken as soon as possible. As AccelStepper::runSpeed() does, the following intervals are
+    /// measured from when it was due, so the time is made up and the mean speed holds, unless stepping
+    /// has fallen AccelStepper::setMaxCatchUp() steps or more behind, or more than 8ms. Then the schedule
+    /// restarts from the current time and the motor runs slower than the set speed.
+    /// \return The number of missed deadlines since the last resetStats()
+    static unsigned long missedDeadlines();
+
+    /// The longest time from a step being due to the interrupt handler starting on it, which is
+    /// how late the step edges can be. This is usually down to other interrupt handlers, 
+    /// or a missed deadline.
+    /// \return The worst latency in microseconds since the last resetStats()
+    static unsigned int maxLatency();
+
+    /// Resets the counts returned by missedDeadlines() and maxLatency()
+    static void    resetStats();
+    /// How long the foreground has before the interrupt handler next runs, so that
+    /// work which must not be interrupted can wait for a gap between steps.
+    /// \return Microseconds to the next compare point, or 0xffff if not running. 
+    /// Long intervals are counted out in chunks, so this can be short of the next step
+    static unsigned int slack();
+
+    /// Called from the Timer1 compare A interrupt handler. Internal use only.
+    static void    isr();
+
+private:
+    /// Sets up Timer1 and takes the first step
+    static void    start();
+
+    /// Sets the next compare point, ticks after the previous one
+    static void    schedule(unsigned long ticks);
+
+    static AccelStepper* volatile _stepper;
+    static StepQueue* volatile    _queue;
+    static volatile boolean       _accelerate;
+    static volatile boolean       _running;
+    static void (* volatile       _onStop)();
+
+    /// Ticks still to be counted out after the current compare point
+    static unsigned long          _remaining;
+
+    /// Where the current compare point should be. OCR1A is later if it was missed
+    static uint16_t               _due;
+
+    /// Timing statistics, see missedDeadlines() and maxLatency()
+    static volatile unsigned long _missedDeadlines;
+    static volatile uint16_t      _maxLatency;
+};
+
+#endif
+#endif 
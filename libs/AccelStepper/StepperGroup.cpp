@@ -0,0 +1,118 @@
+// StepperGroup.cpp
+//
+// Copyright (C) 2014 Russell Gower
+// Use is subject to the same license conditions as AccelStepper (GPL V2)
+
+#include "StepperGroup.h"
+
+StepperGroup::StepperGroup()
+{
+    _num = 0;
+    _master = 0;
+    _masterDelta = 0;
+    _masterSign = 1;
+}
+
+boolean StepperGroup::addStepper(AccelStepper& stepper)
+{
+    if (_num >= STEPPERGROUP_MAX_STEPPERS)
+	return false;
+    _delta[_num] = 0;
+    _forward[_num] = true;
+    _error[_num] = 0;
+    _steppers[_num++] = &stepper;
+    return true;
+}
+
+void StepperGroup::moveTo(long absolute[])
+{
+    uint8_t i;
+
+    // The longest move is the master
+    _master = 0;
+    _masterDelta = 0;
+    for (i = 0; i < _num; i++)
+    {
+	long delta = absolute[i] - _steppers[i]->currentPosition();
+	_forward[i] = delta >= 0;
+	_delta[i] = labs(delta);
+	if (_delta[i] > _masterDelta)
+	{
+	    _master = i;
+	    _masterDelta = _delta[i];
+	}
+    }
+    _masterSign = _forward[_master] ? 1 : -1;
+
+    for (i = 0; i < _num; i++)
+    {
+	if (i == _master)
+	    _steppers[i]->moveTo(absolute[i]);
+	else
+	{
+	    // Stopped, so only follow() moves it
+	    _steppers[i]->setCurrentPosition(_steppers[i]->currentPosition());
+	    _error[i] = _masterDelta / 2; // Round to the nearest step
+	}
+    }
+}
+
+// Bresenham step. Going back reverses going forward exactly, so if the master
+// overshoots and comes back, the slaves retrace their steps too.
+void StepperGroup::follow(long masterStep)
+{
+    for (uint8_t i = 0; i < _num; i++)
+    {
+	if (i == _master)
+	    continue;
+	if (masterStep > 0)
+	{
+	    _error[i] -= _delta[i];
+	    if (_error[i] < 0)
+	    {
+		_error[i] += _masterDelta;
+		_steppers[i]->singleStep(_forward[i]);
+	    }
+	}
+	else
+	{
+	    _error[i] += _delta[i];
+	    if (_error[i] >= _masterDelta)
+	    {
+		_error[i] -= _masterDelta;
+		_steppers[i]->singleStep(!_forward[i]);
+	    }
+	}
+    }
+}
+
+boolean StepperGroup::run()
+{
+    if (!_num)
+	return false;
+
+    AccelStepper* master = _steppers[_master];
+    long position = master->currentPosition();
+    boolean running = master->run();
+    long moved = master->currentPosition() - position;
+    if (moved)
+	follow(moved * _masterSign);
+
+    // The slaves have no speed of their own, so this only ends a non-blocking STEP pulse
+    for (uint8_t i = 0; i < _num; i++)
+	if (i != _master)
+	    _steppers[i]->runSpeed();
+    return running;
+}
+
+void StepperGroup::runToPosition()
+{
+    while (run())
+	;
+}
+
+void StepperGroup::stop()
+{
+    if (_num)
+	_steppers[_master]->stop();
+}
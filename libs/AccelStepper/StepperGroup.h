@@ -0,0 +1,91 @@
+// StepperGroup.h
+//
+// Copyright (C) 2014 Russell Gower
+// Use is subject to the same license conditions as AccelStepper (GPL V2)
+
+#ifndef StepperGroup_h
+#define StepperGroup_h
+
+#include "AccelStepper.h"
+
+/// The most steppers a StepperGroup can hold
+#define STEPPERGROUP_MAX_STEPPERS 4
+
+/////////////////////////////////////////////////////////////////////
+/// \class StepperGroup StepperGroup.h <StepperGroup.h>
+/// \brief Coordinated moves of several AccelSteppers, so they all arrive together
+///
+/// Each AccelStepper runs independently, so steppers given moves of different
+/// lengths arrive at different times and the path between start and end is not a straight line.
+/// StepperGroup moves a set of steppers to a multi-axis target along a straight line,
+/// for example a linear axis and a rotary chuck turning with it.
+///
+/// The stepper with the furthest to go is the master. It runs on its own speed and
+/// acceleration as set with AccelStepper::setMaxSpeed() and AccelStepper::setAcceleration(),
+/// exactly as AccelStepper::run() would move it on its own. Each of the other steppers
+/// is slaved to the master with a Bresenham (DDA) integer error term, and steps on
+/// those master steps that keep it closest to the line. Every axis is within half a
+/// step of the line all the way, and they all arrive on the same step. There is no
+/// floating point per axis, just an add and a compare for each master step.
+///
+/// The slaves step when the master does, so make sure the master's maximum speed
+/// scaled by the ratio of the moves is within each slave's capabilities.
+/// The slaves' own speed settings are not used. While the group is moving, dont call
+/// run() or runSpeed() for any of its steppers.
+class StepperGroup
+{
+public:
+    /// Constructor. The group is empty until steppers are added with addStepper()
+    StepperGroup();
+
+    /// Adds a stepper to the group. The order they are added in is the order of the
+    /// positions passed to moveTo().
+    /// \param[in] stepper The stepper to add
+    /// \return false if the group already holds STEPPERGROUP_MAX_STEPPERS
+    boolean addStepper(AccelStepper& stepper);
+
+    /// Sets a new target position for every stepper in the group, and plans the move.
+    /// Any independent motion of the slaves is stopped.
+    /// \param[in] absolute Array of target positions, one for each stepper in the order they
+    /// were added
+    void    moveTo(long absolute[]);
+
+    /// Polls the group and steps the motors if a step is due, as AccelStepper::run() does.
+    /// Call this as frequently as possible.
+    /// \return true while the master is still moving
+    boolean run();
+
+    /// Moves to the target positions and blocks until they are reached.
+    /// Dont use this in event loops, since it blocks.
+    void    runToPosition();
+
+    /// Stops the group as quickly as possible within the master's acceleration.
+    /// The slaves stop in proportion, so stay on the line.
+    void    stop();
+
+private:
+    /// Takes the slave steps for a master step forward (+1) or back (-1) along the move
+    void    follow(long masterStep);
+
+    /// The steppers in the group
+    AccelStepper* _steppers[STEPPERGROUP_MAX_STEPPERS];
+
+    /// Number of steppers in the group
+    uint8_t       _num;
+
+    /// Index of the stepper with the longest move
+    uint8_t       _master;
+
+    /// Length of the master's move in steps, and its direction, +1 or -1
+    long          _masterDelta;
+    long          _masterSign;
+
+    /// Length of each slave's move in steps, and its direction
+    long          _delta[STEPPERGROUP_MAX_STEPPERS];
+    boolean       _forward[STEPPERGROUP_MAX_STEPPERS];
+
+    /// Bresenham error term for each slave
+    long          _error[STEPPERGROUP_MAX_STEPPERS];
+};
+
+#endif
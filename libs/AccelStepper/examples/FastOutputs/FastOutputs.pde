@@ -0,0 +1,48 @@
+// FastOutputs.pde
+// -*- mode: C++ -*-
+//
+// Compares the time taken to step a stepper driver with digitalWrite()
+// against direct port register writes selected by setFastOutputs().
+// Steps are taken back to back with timerStep(), so the time measured is the time 
+// spent setting the pins. Prints the average time and CPU cycles per step on the Serial monitor.
+// The 1 microsecond minimum pulse width is included in both.
+//
+// Copyright (C) 2014 Russell Gower
+
+#include <AccelStepper.h>
+
+// Define a stepper driver and the pins it will use
+AccelStepper stepper(AccelStepper::DRIVER, A4, A5); // Step on A4, direction on A5
+
+#define STEPS 1000
+
+void benchmark(boolean fast)
+{
+  stepper.setFastOutputs(fast);
+  stepper.setCurrentPosition(0);
+  stepper.moveTo(STEPS);
+  stepper.setSpeed(1000);
+
+  unsigned long start = micros();
+  while (stepper.timerStep(false))
+    ;
+  unsigned long elapsed = micros() - start;
+
+  Serial.print(fast ? "Fast outputs:  " : "digitalWrite(): ");
+  Serial.print((float)elapsed / STEPS);
+  Serial.print(" us, ");
+  Serial.print((float)elapsed * (F_CPU / 1000000L) / STEPS);
+  Serial.println(" cycles per step");
+}
+
+void setup()
+{  
+  Serial.begin(9600);
+  stepper.setMaxSpeed(1000);
+  benchmark(false);
+  benchmark(true);
+}
+
+void loop()
+{
+}
@@ -0,0 +1,50 @@
+// RampTable.pde
+// -*- mode: C++ -*-
+//
+// Compares the cost per step of computing accelerations with Equation 13 in 
+// floating point against the integer ramp table selected by setRampTable(). 
+// Each step is taken with timerStep(), so the time measured is the time spent
+// in the library rather than waiting for steps to be due. Prints the average time 
+// per step and the maximum step rate that supports on the Serial monitor.
+//
+// Copyright (C) 2014 Russell Gower
+
+#include <AccelStepper.h>
+
+void forwardstep() {}
+void backwardstep() {}
+
+// Functional stepper with no outputs, so only the library is timed
+AccelStepper stepper(forwardstep, backwardstep);
+
+void benchmark(boolean rampTable)
+{
+  stepper.setRampTable(rampTable);
+  stepper.setCurrentPosition(0);
+  stepper.setMaxSpeed(100000);
+  stepper.setAcceleration(2000);
+  stepper.moveTo(4000); // Accelerates all the way up and back down
+
+  long steps = 0;
+  unsigned long start = micros();
+  while (stepper.timerStep(true))
+    steps++;
+  unsigned long elapsed = micros() - start;
+
+  Serial.print(rampTable ? "Ramp table:  " : "Equation 13: ");
+  Serial.print((float)elapsed / steps);
+  Serial.print(" us per step, max ");
+  Serial.print(1000000.0 * steps / elapsed);
+  Serial.println(" steps per second");
+}
+
+void setup()
+{  
+  Serial.begin(9600);
+  benchmark(false);
+  benchmark(true);
+}
+
+void loop()
+{
+}
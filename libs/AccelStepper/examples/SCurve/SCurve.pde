@@ -0,0 +1,38 @@
+// SCurve.pde
+// -*- mode: C++ -*-
+//
+// Shows how to choose a jerk limited S-curve profile per move with setJerk().
+// Runs to 4000 and back, alternating between the usual constant acceleration
+// profile and an S-curve, and prints the time each move took on the Serial monitor.
+//
+// Copyright (C) 2014 Russell Gower
+
+#include <AccelStepper.h>
+
+// Define a stepper driver and the pins it will use
+AccelStepper stepper(AccelStepper::DRIVER, 2, 3); // Step on 2, direction on 3
+
+boolean sCurve = false;
+
+void setup()
+{  
+  Serial.begin(9600);
+  stepper.setMaxSpeed(1000);
+  stepper.setAcceleration(2000);
+}
+
+void loop()
+{
+  // The profile is taken up when the move starts
+  stepper.setJerk(sCurve ? 20000 : 0);
+  stepper.moveTo(stepper.currentPosition() == 4000 ? 0 : 4000);
+
+  unsigned long start = millis();
+  stepper.runToPosition();
+  Serial.print(sCurve ? "S-curve " : "Trapezoid ");
+  Serial.print(millis() - start);
+  Serial.println("ms");
+
+  sCurve = !sCurve;
+  delay(500);
+}
@@ -0,0 +1,34 @@
+// SegmentPlanner.pde
+// -*- mode: C++ -*-
+//
+// Shows how to run a path of several segments with SegmentPlanner, without
+// stopping at the junctions between them. Runs out in three segments at
+// different speeds, slowing only as much as each junction needs, then 
+// comes back in one.
+//
+// Copyright (C) 2014 Russell Gower
+
+#include <AccelStepper.h>
+#include <SegmentPlanner.h>
+
+// Define a stepper driver and the pins it will use
+AccelStepper stepper(AccelStepper::DRIVER, 2, 3); // Step on 2, direction on 3
+
+SegmentPlanner planner(stepper);
+
+void setup()
+{  
+  planner.setAcceleration(1000);
+}
+
+void loop()
+{
+  if (!planner.run())
+  {
+    // Out and back again
+    planner.add(1000, 400);
+    planner.add(3000, 800);
+    planner.add(3500, 200);
+    planner.add(0, 1000);
+  }
+}
@@ -0,0 +1,59 @@
+// StaticStepper.pde
+// -*- mode: C++ -*-
+//
+// Compares the time taken to step a stepper driver with AccelStepper against
+// StaticStepper, which has the interface type and pins fixed at compile time.
+// Steps are taken back to back with timerStep(), so the time measured is the time
+// spent stepping. Prints the average time and CPU cycles per step on the Serial monitor.
+// The 1 microsecond minimum pulse width is included in both.
+//
+// To compare code size, build once as it is and once with STATIC_ONLY defined,
+// and compare the sizes reported for the sketch.
+//
+// Copyright (C) 2014 Russell Gower
+
+#include <AccelStepper.h>
+#include <StaticStepper.h>
+
+//#define STATIC_ONLY
+
+#define STEPS 1000
+
+StaticStepper<AccelStepper::DRIVER, A4, A5> staticStepper; // Step on A4, direction on A5
+#ifndef STATIC_ONLY
+AccelStepper stepper(AccelStepper::DRIVER, A4, A5);
+#endif
+
+void benchmark(AccelStepper& s, const char* name)
+{
+  s.setMaxSpeed(1000);
+  s.setCurrentPosition(0);
+  s.moveTo(STEPS);
+  s.setSpeed(1000);
+
+  unsigned long start = micros();
+  while (s.timerStep(false))
+    ;
+  unsigned long elapsed = micros() - start;
+
+  Serial.print(name);
+  Serial.print((float)elapsed / STEPS);
+  Serial.print(" us, ");
+  Serial.print((float)elapsed * (F_CPU / 1000000L) / STEPS);
+  Serial.println(" cycles per step");
+}
+
+void setup()
+{  
+  Serial.begin(9600);
+#ifndef STATIC_ONLY
+  benchmark(stepper, "AccelStepper:             ");
+  stepper.setFastOutputs(true);
+  benchmark(stepper, "AccelStepper fast outputs: ");
+#endif
+  benchmark(staticStepper, "StaticStepper:            ");
+}
+
+void loop()
+{
+}
@@ -0,0 +1,51 @@
+// StepQueue.pde
+// -*- mode: C++ -*-
+//
+// Shows how to work out the steps in loop() and take them from the Timer1
+// interrupt with StepQueue, so the interrupt handler only pops and steps.
+// Runs a jerk limited profile to 4000 and back, and prints how close the 
+// queue came to running dry on the Serial monitor.
+//
+// Copyright (C) 2014 Russell Gower
+
+#include <AccelStepper.h>
+#include <StepQueue.h>
+#include <StepTimer.h>
+
+void forwardstep() {}
+void backwardstep() {}
+
+// Works out the profile only, its steps have no outputs
+AccelStepper profile(forwardstep, backwardstep);
+
+// Define a stepper driver and the pins it will use
+AccelStepper stepper(AccelStepper::DRIVER, 2, 3); // Step on 2, direction on 3
+
+StepQueue queue;
+
+void setup()
+{  
+  Serial.begin(9600);
+  profile.setMaxSpeed(2000);
+  profile.setAcceleration(4000);
+  profile.setJerk(40000);
+}
+
+void loop()
+{
+  if (!StepTimer::running())
+  {
+    Serial.print("Underruns ");
+    Serial.print(queue.underruns());
+    Serial.print(", least depth ");
+    Serial.println(queue.minDepth());
+    queue.resetStats();
+
+    // Reverse, with the queue full before starting
+    profile.moveTo(profile.currentPosition() == 4000 ? 0 : 4000);
+    queue.fill(profile, true);
+    StepTimer::begin(&queue, &stepper);
+  }
+  // Keep it topped up
+  queue.fill(profile, true);
+}
@@ -0,0 +1,32 @@
+// StepTimer.pde
+// -*- mode: C++ -*-
+//
+// Shows how to step a stepper driver from the Timer1 interrupt with StepTimer,
+// so that a slow loop() does not disturb the step timing.
+// Runs to 2000 and back at a constant 500 steps per second while
+// the loop wastes time in long delays.
+//
+// Copyright (C) 2014 Russell Gower
+
+#include <AccelStepper.h>
+#include <StepTimer.h>
+
+// Define a stepper driver and the pins it will use
+AccelStepper stepper(AccelStepper::DRIVER, 2, 3); // Step on 2, direction on 3
+
+void setup()
+{  
+  stepper.setMaxSpeed(1000);
+}
+
+void loop()
+{
+  if (!StepTimer::running())
+  {
+    // Reverse
+    stepper.moveTo(stepper.currentPosition() == 2000 ? 0 : 2000);
+    stepper.setSpeed(stepper.distanceToGo() > 0 ? 500 : -500);
+    StepTimer::begin(&stepper);
+  }
+  delay(30); // Would ruin the step timing with runSpeed()
+}
@@ -0,0 +1,45 @@
+// StepperGroup.pde
+// -*- mode: C++ -*-
+//
+// Shows how to move two steppers together with StepperGroup, so that they
+// start and arrive together and move in a straight line in between.
+// A linear axis runs 2000 steps while a rotary axis turns 600 steps
+// with it, then both go back to the start.
+//
+// Copyright (C) 2014 Russell Gower
+
+#include <AccelStepper.h>
+#include <StepperGroup.h>
+
+// Define two stepper drivers and the pins they will use
+AccelStepper linear(AccelStepper::DRIVER, 2, 3); // Step on 2, direction on 3
+AccelStepper rotary(AccelStepper::DRIVER, 4, 5); // Step on 4, direction on 5
+
+StepperGroup group;
+
+void setup()
+{  
+  // Only the master, the stepper with furthest to go, needs a speed and acceleration
+  linear.setMaxSpeed(1000);
+  linear.setAcceleration(500);
+
+  group.addStepper(linear);
+  group.addStepper(rotary);
+}
+
+void loop()
+{
+  long positions[2];
+
+  positions[0] = 2000;
+  positions[1] = 600;
+  group.moveTo(positions);
+  group.runToPosition();
+  delay(500);
+
+  positions[0] = 0;
+  positions[1] = 0;
+  group.moveTo(positions);
+  group.runToPosition();
+  delay(500);
+}
@@ -0,0 +1,113 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+#include "format.h"
+#include <avr/pgmspace.h>
+
+char *fmtStr(char *p, const char *s, uint8_t width) {
+	while( width && *s ) {
+		*p++ = *s++;
+		width--;
+	}
+	while( width-- )
+		*p++ = ' ';
+	return p;
+}
+
+char *fmtStr_P(char *p, const char *s, uint8_t width) {
+	char c;
+	while( width && (c = pgm_read_byte(s++)) ) {
+		*p++ = c;
+		width--;
+	}
+	while( width-- )
+		*p++ = ' ';
+	return p;
+}
+
+/* Puts the digits of v in from the right, with the point before the
+   last decimals of them */
+static char *fmtScaled(char *p, long v, uint8_t width, uint8_t decimals, char pad) {
+	char *end = p + width, *q = end;
+	unsigned long n = (v < 0) ? -(unsigned long)v : v;
+	uint16_t n16;
+	uint8_t i = 0;
+
+	// 32 bit division is slow on the AVR, so only use it while it's needed
+	for( ;; ) {
+		if( q == p )
+			goto overflow;
+		if( decimals && i == decimals ) {
+			*--q = '.';
+		} else if( n > 0xffff ) {
+			*--q = '0' + n % 10;
+			n /= 10;
+		} else {
+			break;
+		}
+		i++;
+	}
+	n16 = n;
+	for( ;; ) {
+		if( q == p )
+			goto overflow;
+		if( decimals && i == decimals ) {
+			*--q = '.';
+		} else {
+			*--q = '0' + n16 % 10;
+			n16 /= 10;
+			if( !n16 && (!decimals || i > decimals) )
+				break;
+		}
+		i++;
+	}
+
+	if( v < 0 ) {
+		if( q == p )
+			goto overflow;
+		if( pad == '0' ) {
+			while( q > p + 1 )
+				*--q = '0';
+		}
+		*--q = '-';
+	}
+	while( q > p )
+		*--q = pad;
+	return end;
+
+overflow:
+	while( p < end )
+		*p++ = '*';
+	return end;
+}
+
+char *fmtInt(char *p, long v, uint8_t width, char pad) {
+	return fmtScaled(p, v, width, 0, pad);
+}
+
+char *fmtFixed(char *p, float v, uint8_t width, uint8_t decimals, char pad) {
+	float scaled = v;
+	for( uint8_t i = 0; i < decimals; i++ )
+		scaled *= 10;
+	if( scaled >= 2147483647.0 || scaled <= -2147483647.0 ) {
+		while( width-- )
+			*p++ = '*';
+		return p;
+	}
+	return fmtScaled(p, scaled < 0 ? scaled - 0.5 : scaled + 0.5, width, decimals, pad);
+}
@@ -0,0 +1,40 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef FORMAT_H
+#define FORMAT_H
+#include "Arduino.h"
+#include <inttypes.h>
+
+/* Formatting of fields for the LCD, in place of printf. Each writes
+   exactly width chars at p, with no 0 on the end, and returns where it
+   stopped so fields can follow one another along a line. A number that
+   doesn't fit is shown as *s */
+
+/* Text, padded with spaces on the right, eg %-16s */
+char *fmtStr(char *p, const char *s, uint8_t width);
+
+/* The same, from a string in PROGMEM */
+char *fmtStr_P(char *p, const char *s, uint8_t width);
+
+/* A whole number padded on the left, eg %02d with pad '0' */
+char *fmtInt(char *p, long v, uint8_t width, char pad = '0');
+
+/* A number with the given decimals, eg %07.2f with pad '0' */
+char *fmtFixed(char *p, float v, uint8_t width, uint8_t decimals, char pad = '0');
+
+#endif
@@ -0,0 +1,356 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+#include "gcode.h"
+#include <StepTimer.h>
+
+/* What a line asks for, before any of it is queued */
+enum { MOTION_SAME, MOTION_RAPID, MOTION_FEED };
+enum { DIST_SAME, DIST_ABSOLUTE, DIST_RELATIVE };
+enum { OTHER_NONE, OTHER_DWELL, OTHER_SET };
+enum { RELAY_SAME, RELAY_OFF, RELAY_ON };
+
+struct GCode::Line {
+	uint8_t motion;
+	uint8_t distance;
+	uint8_t other;			/* Non modal G4 or G92 */
+	uint8_t relay;
+	bool end;
+	bool hasX;
+	float x;
+	float p;
+	float feed;			/* mm/min, 0 if not given */
+};
+
+GCode::GCode(AccelStepper &stepper, uint8_t relayPin) :
+	m_stepper(stepper), m_relayPin(relayPin), m_system(NULL),
+	m_length(0), m_overflow(false), m_ready(false), m_discard(NULL),
+	m_rapid(true), m_relative(false), m_feed(0), m_x(0),
+	m_head(0), m_tail(0), m_started(false), m_moving(false),
+	m_dwellStart(0), m_dwell(0) {
+}
+
+/* Reads a number at p in place, and moves p past it. The digits are
+   gathered as an integer so there is only one float divide */
+static bool number(const char *&p, float &n) {
+	bool negative = false, digits = false;
+	long mantissa = 0, divisor = 1;
+
+	while( *p == ' ' || *p == '\t' )
+		p++;
+	if( *p == '-' || *p == '+' )
+		negative = (*p++ == '-');
+	for( ; isdigit(*p); p++, digits = true ) {
+		if( mantissa > 9999999 )
+			return false;
+		mantissa = mantissa * 10 + *p - '0';
+	}
+	if( *p == '.' ) {
+		for( p++; isdigit(*p); p++, digits = true ) {
+			if( divisor < 10000 && mantissa <= 9999999 ) {
+				mantissa = mantissa * 10 + *p - '0';
+				divisor *= 10;
+			}
+		}
+	}
+	n = mantissa / (float)divisor;
+	if( negative )
+		n = -n;
+	return digits;
+}
+
+/* Sets *field to value, unless the line has already set it otherwise */
+static bool once(uint8_t *field, uint8_t value) {
+	if( *field && *field != value )
+		return false;
+	*field = value;
+	return true;
+}
+
+/* Reads m_line into line. Returns NULL, or why the line can't be run */
+const __FlashStringHelper *GCode::parse(Line &line) {
+	const char *p = m_line;
+	float n;
+	uint16_t code;
+	char c;
+
+	memset(&line, 0, sizeof(line));
+	while( (c = toupper(*p++)) ) {
+		if( c == ' ' || c == '\t' )
+			continue;
+		if( c == '(' ) {
+			while( *p && *p++ != ')' )
+				;
+			continue;
+		}
+		if( c == ';' )
+			break;
+		if( c < 'A' || c > 'Z' )
+			return F("bad word");
+		if( !number(p, n) )
+			return F("bad number");
+		switch( c ) {
+			case 'G':
+			case 'M':
+				if( n < 0 || n > 999 )
+					return F("unsupported code");
+				code = n * 10 + 0.5;	// G91.1 is 911
+				break;
+			case 'X':
+				line.hasX = true;
+				line.x = n;
+				continue;
+			case 'F':
+				if( n <= 0 )
+					return F("bad feed");
+				line.feed = n;
+				continue;
+			case 'P':
+				line.p = n;
+				continue;
+			default:
+				continue;	// Line numbers, other axes, tools, spindle speed
+		}
+		if( c == 'M' ) {
+			switch( code ) {
+				case 30: case 40:	// Spindle on
+					if( !once(&line.relay, RELAY_ON) )
+						return F("M3 and M5");
+					break;
+				case 50:
+					if( !once(&line.relay, RELAY_OFF) )
+						return F("M3 and M5");
+					break;
+				case 20: case 300:
+					line.end = true;
+					break;
+				case 60: case 70: case 80: case 90:	// Tool change, coolant
+					break;
+				default:
+					return F("unsupported M code");
+			}
+			continue;
+		}
+		switch( code ) {
+			case 0:
+				if( !once(&line.motion, MOTION_RAPID) )
+					return F("G0 and G1");
+				break;
+			case 10:
+				if( !once(&line.motion, MOTION_FEED) )
+					return F("G0 and G1");
+				break;
+			case 40:
+				if( !once(&line.other, OTHER_DWELL) )
+					return F("G4 and G92");
+				break;
+			case 920:
+				if( !once(&line.other, OTHER_SET) )
+					return F("G4 and G92");
+				break;
+			case 900:
+				if( !once(&line.distance, DIST_ABSOLUTE) )
+					return F("G90 and G91");
+				break;
+			case 910:
+				if( !once(&line.distance, DIST_RELATIVE) )
+					return F("G90 and G91");
+				break;
+			case 200: case 700:
+				return F("inches");
+			case 210: case 710:	// mm
+			case 170: case 400: case 430: case 490:	// Plane, compensation
+			case 800: case 911: case 940:	// Canned cycles, arc centres, feed mode
+				break;
+			default:
+				return F("unsupported G code");
+		}
+	}
+	return NULL;
+}
+
+void GCode::push(uint8_t type, float value, float feed) {
+	Command &command = m_queue[m_head];
+
+	command.type = type;
+	command.value = value;
+	command.feed = feed;
+	m_head = (m_head + 1) & (GCODE_QUEUE - 1);
+}
+
+/* Queues what line asks for, in the order it is done within a line:
+   relay on, dwell or set position, move, relay off, end of program */
+const __FlashStringHelper *GCode::queue(const Line &line) {
+	bool rapid = line.motion ? line.motion == MOTION_RAPID : m_rapid;
+	bool relative = line.distance ? line.distance == DIST_RELATIVE : m_relative;
+	float feed = line.feed ? line.feed / 60 : m_feed;
+	bool move = line.hasX && line.other != OTHER_SET;
+
+	if( move && !rapid && feed <= 0 )
+		return F("no feed");
+	m_rapid = rapid;
+	m_relative = relative;
+	m_feed = feed;
+
+	if( line.relay == RELAY_ON )
+		push(CMD_RELAY, 1);
+	if( line.other == OTHER_DWELL )
+		push(CMD_DWELL, line.p);
+	else if( line.other == OTHER_SET && line.hasX ) {
+		m_x = line.x;
+		push(CMD_SET, m_x);
+	}
+	if( move ) {
+		m_x = relative ? m_x + line.x : line.x;
+		push(CMD_MOVE, m_x, rapid ? GCODE_RAPID : feed);
+	}
+	if( line.relay == RELAY_OFF )
+		push(CMD_RELAY, 0);
+	if( line.end ) {
+		push(CMD_END, 0);
+		m_x = 0;
+		m_rapid = true;
+		m_relative = false;
+	}
+	return NULL;
+}
+
+void GCode::add(char c) {
+	if( m_ready )
+		return;		// Only line ends get here while a line is held
+	if( c == '\n' || c == '\r' )
+		m_ready = m_length || m_overflow;	// Blank lines are skipped
+	else if( m_length < GCODE_LINE - 1 )
+		m_line[m_length++] = c;
+	else
+		m_overflow = true;
+}
+
+void GCode::poll() {
+	const __FlashStringHelper *error = NULL;
+	Line line;
+
+	if( !m_ready )
+		return;
+	m_line[m_length] = '\0';
+
+	if( m_overflow )
+		error = F("line too long");
+	else if( m_line[0] == '$' ) {
+		if( m_system )
+			m_system(m_line + 1);
+	}
+	else if( m_line[0] == '%' )
+		m_discard = NULL;	// Starts or ends a program
+	else if( (uint8_t)(m_tail - m_head - 1) % GCODE_QUEUE < GCODE_LINE_CMDS )
+		return;		// Hold the line, and its ok, until there is room
+	else if( !(error = parse(line)) ) {
+		if( m_discard ) {
+			error = m_discard;
+			if( line.end )
+				m_discard = error = NULL;
+		}
+		else
+			error = queue(line);
+	}
+
+	if( error ) {
+		Serial.print(F("error: "));
+		Serial.println(error);
+	}
+	else
+		Serial.println(F("ok"));
+	m_length = 0;
+	m_overflow = m_ready = false;
+}
+
+bool GCode::run(float stepsPerMm) {
+	Command command;
+	long pos;
+	float speed;
+
+	if( !m_started ) {
+		m_started = true;
+		m_stepper.setCurrentPosition(0);
+	}
+	if( m_moving ) {
+		if( StepTimer::running() )
+			return true;
+		m_moving = false;
+	}
+	if( m_dwell ) {
+		if( millis() - m_dwellStart < m_dwell )
+			return true;
+		m_dwell = 0;
+	}
+
+	while( pending() ) {
+		command = m_queue[m_tail];
+		m_tail = (m_tail + 1) & (GCODE_QUEUE - 1);
+		switch( command.type ) {
+			case CMD_MOVE:
+				// Constant speed as a program's run, mm/s * steps/mm = steps/s
+				pos = lround(command.value * stepsPerMm);
+				if( pos == m_stepper.currentPosition() )
+					break;
+				speed = command.feed * stepsPerMm;
+				m_stepper.setMaxSpeed(speed);
+				m_stepper.moveTo(pos);
+				m_stepper.setSpeed(pos < m_stepper.currentPosition() ? -speed : speed);
+				StepTimer::begin(&m_stepper);
+				m_moving = true;
+				return true;
+			case CMD_DWELL:
+				m_dwell = command.value * 1000;
+				m_dwellStart = millis();
+				if( m_dwell )
+					return true;
+				break;
+			case CMD_RELAY:
+				digitalWrite(m_relayPin, command.value ? HIGH : LOW);
+				break;
+			case CMD_SET:
+				m_stepper.setCurrentPosition(lround(command.value * stepsPerMm));
+				break;
+			case CMD_END:
+				digitalWrite(m_relayPin, LOW);
+				m_started = false;
+				return false;
+		}
+	}
+	return true;
+}
+
+void GCode::abort(const __FlashStringHelper *reason) {
+	uint8_t dropped = (m_head - m_tail) & (GCODE_QUEUE - 1);
+
+	m_discard = reason ? reason : F("aborted");
+	// The lines queued have been answered ok, so the sender is told
+	Serial.print(F("error: "));
+	Serial.print(m_discard);
+	Serial.print(F(", dropped "));
+	Serial.println(dropped + m_moving + (m_dwell != 0));
+	StepTimer::end();
+	digitalWrite(m_relayPin, LOW);
+	m_head = m_tail = 0;
+	m_started = m_moving = false;
+	m_dwell = 0;
+	m_x = 0;
+	m_rapid = true;
+	m_relative = false;
+}
@@ -0,0 +1,104 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef GCODE_H
+#define GCODE_H
+#include "Arduino.h"
+#include <inttypes.h>
+#include <AccelStepper.h>
+
+/* Longest line, and how many commands can wait to be run */
+#define GCODE_LINE  64
+#define GCODE_QUEUE 8	/* A power of 2 */
+#define GCODE_LINE_CMDS 4	/* Most commands one line can queue */
+
+/* Speed of G0 moves, in mm/s */
+#define GCODE_RAPID 20
+
+/* Runs a subset of G-code from Serial on the X axis:
+	G0 G1	Move, X in mm and F in mm/min
+	G4	Dwell for P seconds
+	G90 G91	Absolute or relative X
+	G92	Set the current position to X
+	M3 M4	Torch relay on, M5 off
+	M2 M30	End of program
+   Line numbers, comments, G17 G21 G40 G43 G49 G80 G94, other axes and
+   other words are accepted and ignored, so Mach3 files of straight moves
+   in mm run as they are. Arcs (G2 G3) and inches (G20 G70) are refused.
+   Each line is answered with ok once its commands are queued,
+   or error: and the reason, and the next line is not read until there
+   is room for it, so a sender that waits for each ok never overruns.
+   An abort sends error: and why, and how many queued commands it dropped,
+   at once. Lines are then answered with error: and why, so the rest of
+   the aborted program doesn't run, until an M2, M30 or % line, which is
+   answered with ok and starts afresh. A % line is otherwise ignored
+   Lines starting with $ are passed to the system command handler */
+class GCode {
+public:
+	GCode(AccelStepper &stepper, uint8_t relayPin);
+	void setSystem(void (*system)(const char *line)) { m_system = system; }
+	void add(char c);		/* Text from Serial */
+	void poll();			/* Answers and queues a whole line */
+	bool held() { return m_ready; }	/* A line is waiting for room */
+	bool pending() { return m_head != m_tail; }
+	/* Runs the queue, moving stepsPerMm steps for each mm. Returns
+	   false once the program has ended and everything has been run */
+	bool run(float stepsPerMm);
+	/* Stops, empties the queue and says so. Lines are then answered with
+	   error: and reason, or aborted, until the end of program */
+	void abort(const __FlashStringHelper *reason = NULL);
+
+private:
+	enum { CMD_MOVE, CMD_DWELL, CMD_RELAY, CMD_SET, CMD_END };
+	struct Command {
+		uint8_t type;
+		float value;		/* X in mm, seconds, or relay on */
+		float feed;		/* mm/s */
+	};
+	struct Line;
+	const __FlashStringHelper *parse(Line &line);
+	const __FlashStringHelper *queue(const Line &line);
+	void push(uint8_t type, float value, float feed = 0);
+
+	AccelStepper &m_stepper;
+	uint8_t m_relayPin;
+	void (*m_system)(const char *line);
+
+	char m_line[GCODE_LINE];
+	uint8_t m_length;
+	bool m_overflow;		/* Dropping the rest of a long line */
+	bool m_ready;			/* m_line is whole, waiting for room */
+	/* Why it aborted, NULL once the program has ended */
+	const __FlashStringHelper *m_discard;
+
+	/* Modal state of the parser */
+	bool m_rapid;
+	bool m_relative;
+	float m_feed;			/* mm/s */
+	float m_x;			/* Where queued moves end, in mm */
+
+	Command m_queue[GCODE_QUEUE];
+	uint8_t m_head, m_tail;
+
+	/* What run() is doing */
+	bool m_started;
+	bool m_moving;
+	unsigned long m_dwellStart;
+	unsigned long m_dwell;		/* ms, 0 if not dwelling */
+};
+
+#endif
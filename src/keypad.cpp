@@ -17,12 +17,22 @@
 */
 
 #include "keypad.h"
+#include <avr/interrupt.h>
+
+/* The keypad being scanned from the ADC interrupt */
+static KeyPad *scanning = 0;
 
 KeyPad::KeyPad(uint8_t pin) {
 	m_pin            = pin;
 	m_holdMultiplier = 1;
 	m_threshold      = 60;
 	m_debounce 	 = 120;
+	m_scan           = false;
+	m_raw = m_key    = BTN_NONE;
+	m_steady         = 0;
+	m_repeats        = 0;
+	m_head = m_tail  = 0;
+	m_dropped        = 0;
 	
 	//pinMode(pin, INPUT);
 	//digitalWrite(pin, HIGH);
@@ -30,15 +40,30 @@ KeyPad::KeyPad(uint8_t pin) {
 
 uint8_t KeyPad::read() {
 
+	if( m_scan ) {
+		// Presses and repeats, as the polled read gives them
+		KeyEvent e;
+		while( event(e) ) {
+			if( e.type == KEY_PRESS || e.type == KEY_REPEAT ) {
+				m_holdMultiplier = 1;
+				for( uint8_t i = 10; i <= e.repeats && m_holdMultiplier < 10000; i += 10 )
+					m_holdMultiplier *= 10;
+				return e.key;
+			}
+		}
+		return BTN_NONE;
+	}
+
 	static unsigned long lastTime = millis();
 	static unsigned int  held = 0;
 	static uint8_t       oldBTN = BTN_NONE;
 	static uint8_t       holdBTN = BTN_NONE;
-	static int           oldADC = 0;
 
 	uint8_t newBTN = BTN_NONE;
 	int newADC = analogRead(m_pin);
 /*
+	static int oldADC = 0;
+
 	// filter out any analog jitter
 	if( abs(oldADC - newADC) > m_threshold ) {
 		oldADC = newADC;
@@ -92,3 +117,86 @@ int KeyPad::HoldMultiplier(int max ) {
 	else
 		return m_holdMultiplier;
 }
+
+/* The ADC converts the keypad each time Timer0 overflows, which the
+   Arduino core has happen every 1024us for millis(). That is often
+   enough for the keys and costs far less than free running */
+void KeyPad::beginScan() {
+	uint8_t channel = (m_pin >= A0) ? m_pin - A0 : m_pin;
+	uint8_t oldSREG = SREG;
+	cli();
+	scanning = this;
+	m_scan = true;
+	ADMUX = _BV(REFS0) | (channel & 7);	// AVcc reference, as analogRead()
+	ADCSRB = _BV(ADTS2);			// Start on Timer0 overflow
+	DIDR0 |= _BV(channel);			// The digital input isn't needed
+	ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADIF) |
+		 _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);	// clk/128, 125kHz
+	SREG = oldSREG;
+}
+
+bool KeyPad::event(KeyEvent &e) {
+	if( m_tail == m_head )
+		return false;
+	e = m_events[m_tail];
+	m_tail = (m_tail + 1) & (KEY_EVENTS - 1);
+	return true;
+}
+
+void KeyPad::push(uint8_t type) {
+	uint8_t next = (m_head + 1) & (KEY_EVENTS - 1);
+	if( next == m_tail ) {
+		m_dropped++;
+		return;
+	}
+	m_events[m_head].type = type;
+	m_events[m_head].key = m_key;
+	m_events[m_head].repeats = m_repeats;
+	m_events[m_head].time = millis();
+	m_head = next;
+}
+
+void KeyPad::sample(int adc) {
+	uint8_t key = BTN_NONE;
+	unsigned int held;
+
+	// map adc value to button code
+	for( uint8_t i = 0; i <5; i++ ) {
+		if ( adc < adc_key_val[i][0] ) 
+			key = adc_key_val[i][1];
+	}
+
+	if( key != m_raw ) {
+		m_raw = key;
+		m_steady = 0;
+		return;
+	}
+	if( m_steady < 0xffff )
+		m_steady++;
+
+	if( m_steady == KEY_DEBOUNCE && key != m_key ) {
+		if( m_key != BTN_NONE )
+			push(KEY_RELEASE);
+		m_key = key;
+		m_repeats = 0;
+		if( m_key != BTN_NONE )
+			push(KEY_PRESS);
+		return;
+	}
+	if( m_key == BTN_NONE || m_steady <= KEY_DEBOUNCE )
+		return;
+
+	held = m_steady - KEY_DEBOUNCE;
+	if( held == KEY_LONG_PRESS )
+		push(KEY_LONG);
+	if( held >= KEY_REPEAT_DELAY && (held - KEY_REPEAT_DELAY) % KEY_REPEAT == 0 ) {
+		push(KEY_REPEAT);
+		if( m_repeats < 255 )
+			m_repeats++;
+	}
+}
+
+ISR(ADC_vect) {
+	if( scanning )
+		scanning->sample(ADC);
+}
@@ -29,18 +29,56 @@ const int adc_key_val[5][2] = {
 				{50,  BTN_RIGHT}
 			  };
 
+/* Key events, from the ADC interrupt once beginScan() is called */
+enum { KEY_PRESS, KEY_RELEASE, KEY_REPEAT, KEY_LONG };
+
+struct KeyEvent {
+	uint8_t type;
+	uint8_t key;
+	uint8_t repeats;	/* How many KEY_REPEATs before this one */
+	uint16_t time;		/* Low 16 bits of millis() */
+};
+
+/* Timings of the interrupt driven scan, in samples of about 1ms */
+#define KEY_DEBOUNCE     20	/* The reading must be steady this long */
+#define KEY_REPEAT_DELAY 500	/* Held this long before the first repeat */
+#define KEY_REPEAT       120	/* Then a repeat this often */
+#define KEY_LONG_PRESS   1000	/* Held this long for KEY_LONG */
+
+/* How many events can wait to be read, a power of 2 */
+#define KEY_EVENTS 8
+
 class KeyPad {
 public:
 	KeyPad(uint8_t pin);
 	uint8_t read();
 	int HoldMultiplier(int max = 0);
+
+	/* Sample the keypad from the ADC interrupt from now on, rather than
+	   with analogRead() in read(). Nothing else may use the ADC after */
+	void beginScan();
+	bool event(KeyEvent &e);	/* The next event, if there is one */
+	unsigned int dropped() { return m_dropped; }
+	void sample(int adc);		/* From the ADC interrupt */
 	
 private:
+	void push(uint8_t type);
+
 	int m_holdMultiplier;
 	int m_threshold;
 	unsigned int m_debounce;
 	uint8_t m_pin;
 
+	/* The interrupt driven scan */
+	bool m_scan;
+	uint8_t m_raw;			/* Key read by the last sample */
+	uint8_t m_key;			/* Key after debouncing */
+	unsigned int m_steady;		/* Samples m_raw has been the same */
+	uint8_t m_repeats;
+	KeyEvent m_events[KEY_EVENTS];
+	volatile uint8_t m_head;	/* Written only by the interrupt */
+	volatile uint8_t m_tail;	/* Written only by event() */
+	volatile unsigned int m_dropped;
 };
 	
 
@@ -0,0 +1,95 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+#include "lcdbuffer.h"
+
+LcdBuffer::LcdBuffer(LiquidCrystal &lcd) : m_lcd(lcd) {
+	m_col = m_row = 0;
+	memset(m_want, ' ', sizeof(m_want));
+	invalidate();
+}
+
+/* Nothing matches a 0, so every cell is sent again */
+void LcdBuffer::invalidate() {
+	memset(m_shown, 0, sizeof(m_shown));
+	m_lcdCol = LCD_COLS;
+	m_lcdRow = 0;
+	m_dirty = true;
+}
+
+void LcdBuffer::clear() {
+	memset(m_want, ' ', sizeof(m_want));
+	m_col = m_row = 0;
+	m_dirty = true;
+}
+
+void LcdBuffer::setCursor(uint8_t col, uint8_t row) {
+	m_col = col;
+	m_row = (row < LCD_ROWS) ? row : LCD_ROWS - 1;
+}
+
+/* Text past the end of a line is lost, as it would be off screen */
+size_t LcdBuffer::write(uint8_t c) {
+	if( m_col >= LCD_COLS )
+		return 1;
+	if( m_want[m_row][m_col] != (char)c ) {
+		m_want[m_row][m_col] = c;
+		m_dirty = true;
+	}
+	m_col++;
+	return 1;
+}
+
+void LcdBuffer::update() {
+	uint8_t budget = LCD_BUDGET;
+	uint8_t row = 0, col = 0;
+
+	if( !m_dirty )
+		return;
+	while( budget ) {
+		// The next cell that differs, looking on from the LCD's address
+		// first so a run of changes goes out without cursor moves
+		if( m_lcdCol < LCD_COLS && m_want[m_lcdRow][m_lcdCol] != m_shown[m_lcdRow][m_lcdCol] ) {
+			row = m_lcdRow;
+			col = m_lcdCol;
+		} else {
+			for( row = 0; row < LCD_ROWS; row++ ) {
+				for( col = 0; col < LCD_COLS; col++ ) {
+					if( m_want[row][col] != m_shown[row][col] )
+						break;
+				}
+				if( col < LCD_COLS )
+					break;
+			}
+			if( row == LCD_ROWS ) {
+				m_dirty = false;
+				return;
+			}
+		}
+		budget--;
+		if( row != m_lcdRow || col != m_lcdCol ) {
+			m_lcd.setCursor(col, row);
+			m_lcdRow = row;
+			m_lcdCol = col;
+			continue;
+		}
+		m_lcd.write(m_want[row][col]);
+		m_shown[row][col] = m_want[row][col];
+		m_lcdCol++;	// Off the end of the line is LCD_COLS, unknown
+	}
+}
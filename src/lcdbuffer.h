@@ -0,0 +1,58 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef LCDBUFFER_H
+#define LCDBUFFER_H
+#include "Arduino.h"
+#include <inttypes.h>
+#include <LiquidCrystal.h>
+
+#define LCD_COLS 16
+#define LCD_ROWS 2
+
+/* How many LCD commands update() sends at most. Each takes about 300us
+   in 4 bit mode, so this bounds the time the LCD takes from a pass */
+#ifndef LCD_BUDGET
+#define LCD_BUDGET 1
+#endif
+
+/* A copy of the display in RAM. Text is written to the copy, and
+   update() sends the cells that differ from what the LCD shows, a few
+   at a time, moving the cursor only when the next cell to change isn't
+   where the LCD's address already is */
+class LcdBuffer : public Print {
+public:
+	LcdBuffer(LiquidCrystal &lcd);
+	void invalidate();	/* The LCD was written to directly */
+	void clear();
+	void setCursor(uint8_t col, uint8_t row);
+	virtual size_t write(uint8_t c);
+	using Print::write;
+	void update();		/* Call from loop() */
+	bool busy() { return m_dirty; }
+
+private:
+	LiquidCrystal &m_lcd;
+	char m_want[LCD_ROWS][LCD_COLS];	/* What should be shown */
+	char m_shown[LCD_ROWS][LCD_COLS];	/* What the LCD shows */
+	uint8_t m_col, m_row;		/* Where write() goes */
+	uint8_t m_lcdCol, m_lcdRow;	/* The LCD's address, m_lcdCol is
+					   LCD_COLS if it is not known */
+	bool m_dirty;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+#include "link.h"
+
+uint8_t crc8(uint8_t crc, uint8_t data) {
+	crc ^= data;
+	for( uint8_t i = 0; i < 8; i++ )
+		crc = (crc & 1) ? (crc >> 1) ^ 0x8C : (crc >> 1);
+	return crc;
+}
+
+Link::Link() : m_handler(NULL), m_state(LINK_IDLE) {
+}
+
+bool Link::add(uint8_t c) {
+	unsigned long now = millis();
+
+	// A frame that stopped part way is dropped, so it can't swallow text
+	if( m_state != LINK_IDLE && now - m_last > LINK_TIMEOUT )
+		m_state = LINK_IDLE;
+	m_last = now;
+
+	switch( m_state ) {
+		case LINK_IDLE:
+			if( c != LINK_STX )
+				return false;
+			m_crc = 0;
+			m_state = LINK_LENGTH;
+			return true;
+		case LINK_LENGTH:
+			m_length = c;
+			m_count = 0;
+			m_state = LINK_TYPE;
+			break;
+		case LINK_TYPE:
+			m_type = c;
+			m_state = m_length ? LINK_DATA_BYTES : LINK_CRC;
+			break;
+		case LINK_DATA_BYTES:
+			if( m_count < LINK_DATA )
+				m_data[m_count] = c;
+			if( ++m_count == m_length )
+				m_state = LINK_CRC;
+			break;
+		case LINK_CRC:
+			m_state = LINK_IDLE;
+			if( crc8(m_crc, c) )
+				reply(LINK_NAK, m_type, LINK_BAD_CRC);
+			else if( m_length > LINK_DATA )
+				reply(LINK_NAK, m_type, LINK_BAD_LENGTH);
+			else if( m_handler )
+				m_handler(m_type, m_data, m_length);
+			return true;
+	}
+	m_crc = crc8(m_crc, c);
+	return true;
+}
+
+bool Link::room(uint8_t length) {
+	return Serial.availableForWrite() >= length + 4;
+}
+
+void Link::send(uint8_t type, const uint8_t *data, uint8_t length) {
+	uint8_t crc = crc8(crc8(0, length), type);
+
+	Serial.write(LINK_STX);
+	Serial.write(length);
+	Serial.write(type);
+	for( uint8_t i = 0; i < length; i++ ) {
+		Serial.write(data[i]);
+		crc = crc8(crc, data[i]);
+	}
+	Serial.write(crc);
+}
+
+/* LINK_ACK or LINK_NAK, of the request's type and a value */
+void Link::reply(uint8_t type, uint8_t request, uint8_t value) {
+	uint8_t data[2] = { request, value };
+	send(type, data, sizeof(data));
+}
@@ -0,0 +1,90 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef LINK_H
+#define LINK_H
+#include "Arduino.h"
+#include <inttypes.h>
+
+/* A frame is LINK_STX, the length of its data, its type, the data, then a
+   CRC8 of the length, type and data. Text never holds LINK_STX, so frames
+   can be sent on the same Serial line as G-code */
+#define LINK_STX 0x02
+#define LINK_DATA 20		/* Most data in a frame */
+#define LINK_TIMEOUT 100	/* ms between bytes before a frame is dropped */
+
+/* Frame types. Each request is answered with the frames shown, and a
+   request that can't be done with LINK_NAK of its type and why:
+	LINK_STATUS	Answered with LINK_STATUS of the menu state, program,
+			its saved type, or 0xff if its record is corrupt,
+			LINK_ flags and the motor position in steps
+			as 4 bytes, low byte first
+	LINK_READ	Of a program number, or of nothing for every program.
+			Answered with LINK_RECORD of each, then LINK_ACK of
+			how many were sent
+	LINK_WRITE	Of a program number and its EEPROM record. Only the
+			bytes that differ are written, a byte each pass of
+			loop(), and once they all are it is answered with
+			LINK_ACK of how many were. Reads, starts and other
+			writes are refused until then
+	LINK_START	Of a program number, starts its count down
+	LINK_ABORT	Stops a count down, run, rewind or G-code
+	LINK_REWIND	Rewinds a finished run
+   Control requests are answered with LINK_ACK of the new menu state */
+enum { LINK_STATUS = 1, LINK_READ, LINK_WRITE, LINK_START, LINK_ABORT,
+       LINK_REWIND, LINK_RECORD, LINK_ACK, LINK_NAK };
+
+/* Why a request was refused, with LINK_NAK */
+enum { LINK_BAD_CRC = 1, LINK_BAD_LENGTH, LINK_UNKNOWN, LINK_BUSY,
+       LINK_BAD_PRG, LINK_BAD_RECORD };
+
+/* LINK_STATUS flags */
+#define LINK_RUNNING _BV(0)	/* The motor is moving */
+#define LINK_RELAY   _BV(1)	/* The torch relay is on */
+#define LINK_GCODE   _BV(2)	/* G-code is waiting to run */
+
+/* CRC8 as avr-libc's _crc_ibutton_update(). Taking the CRC of a frame
+   or program record with its CRC on the end gives 0 */
+uint8_t crc8(uint8_t crc, uint8_t data);
+
+/* Reads frames a byte at a time, so a frame can arrive over several
+   calls, and passes each good one to the handler */
+class Link {
+public:
+	Link();
+	void setHandler(void (*handler)(uint8_t type, const uint8_t *data, uint8_t length))
+		{ m_handler = handler; }
+	bool add(uint8_t c);		/* False if c isn't part of a frame */
+	bool inFrame() { return m_state != LINK_IDLE; }
+	bool room(uint8_t length);	/* For a frame, without waiting */
+	void send(uint8_t type, const uint8_t *data, uint8_t length);
+	void reply(uint8_t type, uint8_t request, uint8_t value);
+
+private:
+	enum { LINK_IDLE, LINK_LENGTH, LINK_TYPE, LINK_DATA_BYTES, LINK_CRC };
+
+	void (*m_handler)(uint8_t type, const uint8_t *data, uint8_t length);
+	uint8_t m_state;
+	uint8_t m_length;
+	uint8_t m_type;
+	uint8_t m_count;		/* Data bytes so far */
+	uint8_t m_crc;
+	unsigned long m_last;		/* millis() of the last byte */
+	uint8_t m_data[LINK_DATA];
+};
+
+#endif
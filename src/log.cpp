@@ -0,0 +1,120 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+#include "log.h"
+#include <avr/pgmspace.h>
+
+Logger Log;
+
+/* The text of each record, with # where its numbers go. A digit after
+   the # is how many places of decimals the number is in */
+#define LOG_TEXT 24
+static const char messages[LOG_MESSAGES][LOG_TEXT] PROGMEM = {
+	"Log dropped #",
+	"EEPROM erased",
+	"EEPROM converted",
+	"Load #",
+	"Bad CRC in #",
+	"Save #, wrote #",
+	"Event # late #us",
+	"Run #1mm in #1s",
+	"Speed #2mm/s of #2",
+	"Missed #, latency #us",
+};
+
+Logger::Logger() {
+	m_head = m_tail = 0;
+	m_dropped = m_total = 0;
+}
+
+void Logger::add(uint8_t id, int32_t a, int32_t b) {
+	uint8_t next = (m_head + 1) & (LOG_RECORDS - 1);
+	if( next == m_tail ) {
+		m_dropped++;
+		m_total++;
+		return;
+	}
+	m_records[m_head].id = id;
+	m_records[m_head].a = a;
+	m_records[m_head].b = b;
+	m_head = next;
+}
+
+/* Writes n at p with places decimals, returns the end */
+static char *number(char *p, int32_t n, uint8_t places) {
+	uint32_t scale = 1, u = n < 0 ? -(uint32_t)n : n;
+
+	if( !places ) {
+		ltoa(n, p, 10);
+		return p + strlen(p);
+	}
+	while( places-- )
+		scale *= 10;
+	if( n < 0 )
+		*p++ = '-';
+	ultoa(u / scale, p, 10);
+	p += strlen(p);
+	*p++ = '.';
+	for( scale /= 10; scale; scale /= 10 )
+		*p++ = '0' + u / scale % 10;
+	return p;
+}
+
+/* Only writes a record if all of it fits, so Serial never waits */
+bool Logger::send(uint8_t id, int32_t a, int32_t b) {
+	// The text, two numbers of up to 11 chars and a point, and CR LF
+	char line[LOG_TEXT + 2 * 12 + 2], *p = line;
+	int32_t arg = a;
+	uint8_t places;
+	char c;
+
+	for( uint8_t i = 0; i < LOG_TEXT && (c = pgm_read_byte(&messages[id][i])); i++ ) {
+		if( c == '#' ) {
+			c = pgm_read_byte(&messages[id][i + 1]);
+			places = 0;
+			if( c >= '0' && c <= '9' ) {
+				places = c - '0';
+				i++;
+			}
+			p = number(p, arg, places);
+			arg = b;
+		} else {
+			*p++ = c;
+		}
+	}
+	*p++ = '\r';
+	*p++ = '\n';
+	if( Serial.availableForWrite() < p - line )
+		return false;
+	Serial.write((const uint8_t *)line, p - line);
+	return true;
+}
+
+void Logger::poll() {
+	if( m_dropped ) {
+		if( !send(LOG_DROPPED, m_dropped, 0) )
+			return;
+		m_dropped = 0;
+	}
+	while( m_tail != m_head ) {
+		Record &r = m_records[m_tail];
+		if( !send(r.id, r.a, r.b) )
+			return;
+		m_tail = (m_tail + 1) & (LOG_RECORDS - 1);
+	}
+}
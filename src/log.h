@@ -0,0 +1,73 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef LOG_H
+#define LOG_H
+#include "Arduino.h"
+#include <inttypes.h>
+
+/* Log levels. Calls above LOG_LEVEL are left out when compiling */
+#define LOG_OFF   0
+#define LOG_ERROR 1
+#define LOG_INFO  2
+#define LOG_DEBUG 3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO
+#endif
+
+/* What a record is. Each has a message in log.cpp, in the same order */
+enum { LOG_DROPPED, LOG_ERASED, LOG_CONVERTED, LOG_LOAD, LOG_BAD_CRC,
+       LOG_SAVE, LOG_TIMING, LOG_RUN, LOG_RUN_SPEED, LOG_RUN_STEPS,
+       LOG_MESSAGES };
+
+/* How many records can wait to be sent, a power of 2 */
+#define LOG_RECORDS 16
+
+#define LOG(level, id, a, b) do { \
+	if( (level) <= LOG_LEVEL ) \
+		Log.add((id), (a), (b)); \
+	} while(0)
+
+/* Logging that doesn't wait for Serial. A record is kept in RAM as its id
+   and two 32 bit numbers, and is only turned into text when poll() finds room
+   for it in Serial's transmit buffer, which the UART interrupt empties.
+   When the records are full new ones are dropped and counted. Only for
+   use outside interrupts */
+class Logger {
+public:
+	Logger();
+	void add(uint8_t id, int32_t a = 0, int32_t b = 0);
+	void poll();		/* Call from loop() */
+	uint16_t dropped() { return m_total; }	/* Ever dropped */
+
+private:
+	struct Record {
+		uint8_t id;
+		int32_t a, b;
+	};
+	bool send(uint8_t id, int32_t a, int32_t b);
+
+	Record m_records[LOG_RECORDS];
+	uint8_t m_head;		/* Next record to add */
+	uint8_t m_tail;		/* Next record to send */
+	uint16_t m_dropped;	/* Since the last LOG_DROPPED was sent */
+	uint16_t m_total;	/* Ever dropped */
+};
+extern Logger Log;
+
+#endif
@@ -16,9 +16,19 @@
 * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 */
 #include <AccelStepper.h>
+#include <StaticStepper.h>
+#include <StepTimer.h>
 #include <LiquidCrystal.h>
 #include <eeprom.h>
 #include "keypad.h"
+#include "profiler.h"
+#include "log.h"
+#include "lcdbuffer.h"
+#include "format.h"
+#include "scheduler.h"
+#include "gcode.h"
+#include "link.h"
+#include "timeline.h"
 
 /* Define PIN functions */
 enum { pKEY = 0, pRELAY = A3, pSTEP = A4, pDIR = A5,
@@ -31,16 +41,17 @@ enum { MNU_SELECT_PRG, MNU_SELECT_RUN, MNU_SELECT_EDIT,
        MNU_REWIND, MNU_RETURN,
        MNU_EDIT_TYPE, MNU_EDIT_STEPS, MNU_EDIT_SPEED, MNU_EDIT_PRE_START,
        MNU_EDIT_LENGTH, MNU_EDIT_RADIUS, MNU_EDIT_CIRCUMFERENCE,
-       MNU_EDIT_SAVE_NO, MNU_EDIT_SAVE_YES
+       MNU_EDIT_SAVE_NO, MNU_EDIT_SAVE_YES, MNU_GCODE, MNU_STATES
 };
 
 
 /* EEPROM versioning */
-const char version[] = "0001";
+const char version[] = "0002";
+const char version1[] = "0001";
 
 /* Programs types */
 enum { PRG_EMPTY = 0, PRG_LINEAR, PRG_ROTARY, PRG_LAST };
-char PRG_TYPES[4][9] = { "<Empty>", "<Linear>", "<Rotary>", ""};
+#define PRG_BAD 0xff	// Directory entry for a slot that fails its CRC
 
 /* These enum's are indexes into the Program_s structure */
 enum { VAL_STEPS = 0, VAL_SPEED = 1, VAL_PRE_START = 2, VAL_LENGTH = 3,
@@ -52,62 +63,259 @@ struct Program_s {
 
 union Program_u {
 	Program_s P;
-	char C[];
+	char C[sizeof(Program_s)];
 } Program;
 
-/* How many programs can we store in FLASH */
-int maxPrgs = (1024 - sizeof(version)) / sizeof(Program);
+/* Programs are kept in EEPROM after the version as records of the type,
+   then each value in hundredths as a 24 bit integer, low byte first,
+   then a CRC8 of the record. Version 0001 kept Program as it is in RAM */
+#define PRG_SCALE 100
+#define PRG_RECORD (1 + 3 * 5 + 1)
+#define MAX_PRGS ((1024 - sizeof(version)) / PRG_RECORD)
+
+/* How long the relay stays on after the motor stops, in ms. Raise it to
+   hold the arc over the end of the weld */
+#define POST_FLOW 0
+
+/* How many programs can we store in EEPROM */
+const int maxPrgs = MAX_PRGS;
+
+/* The type of each program, read once at boot so browsing
+   doesn't have to read EEPROM */
+uint8_t directory[MAX_PRGS];
 
 int state = MNU_SELECT_PRG;
 uint8_t updateLCD = 1;
 int curPrg = 1;
 int countdown;
+uint8_t key = BTN_NONE; // From the keypad task, for the menu task
+int readPrg = 0, readLast;	// Programs still to send for a LINK_READ
+uint8_t readSent;
+int writePrg = 0;		// Program of a LINK_WRITE still being written
+uint8_t writeRec[PRG_RECORD], writeNext, writeCount;
+
+/* Tasks, see setup() */
+void keypadTask();
+void menuTask();
+void lcdTask();
+void logTask();
+void systemCommand(const char *line);
+void serialTask();
+void linkFrame(uint8_t type, const uint8_t *data, uint8_t length);
 
 KeyPad KEY(pKEY);
+Profiler PROFILE;
+Scheduler TASKS;
 LiquidCrystal lcd(pRS, pRW, pENABLE, pD4, pD5, pD6, pD7);
-AccelStepper stepper(AccelStepper::DRIVER, pSTEP, pDIR);
+LcdBuffer screen(lcd);
+StaticStepper<AccelStepper::DRIVER, pSTEP, pDIR> stepper;
+GCode GCODE(stepper, pRELAY);
+Link LINK;
+Timeline TIMELINE(stepper, pRELAY);
 
-/* To allow printf to lcd */
-static FILE lcdout = {0};
-static int lcd_putchar(char ch, FILE* stream)
-{
-    lcd.write(ch) ;
-    return (0) ;
-}
+/* Text for the LCD, kept in flash. A run of #s is filled with a number,
+   with decimals after a . in the run */
+enum { LBL_BLANK, LBL_PROGRAM, LBL_BAD_CRC, LBL_SELECT_PRG, LBL_SELECT_RUN,
+       LBL_SELECT_EDIT, LBL_COUNTDOWN, LBL_PRE_START, LBL_RUNNING, LBL_ABORT,
+       LBL_FINISHED, LBL_REWIND, LBL_RETURN, LBL_TYPE,
+       LBL_EMPTY, LBL_LINEAR, LBL_ROTARY,	// In PRG_ order
+       LBL_SAVE, LBL_SAVE_NO, LBL_SAVE_YES, LBL_STEPS_MM, LBL_STEPS_REV,
+       LBL_SPEED, LBL_START_DELAY, LBL_LENGTH, LBL_RADIUS, LBL_CIRCUMFERENCE,
+       LBL_VALUE, LBL_GCODE, LBL_LAST };
+const char labels[LBL_LAST][LCD_COLS + 1] PROGMEM = {
+	"",
+	"Program",
+	"Program  Bad CRC",
+	" <##> Run Edit",
+	"  ## <Run>Edit",
+	"  ##  Run<Edit>",
+	"Count Down ##",
+	"Pre Start ####",
+	"Running",
+	"<Abort>",
+	"Finished",
+	"<Rewind> Return",
+	" Rewind <Return>",
+	"Type",
+	"<Empty>",
+	"<Linear>",
+	"<Rotary>",
+	"Save Changes?",
+	"<NO> YES",
+	" NO <YES>",
+	"Steps /mm",
+	"Steps /rev",
+	"Speed mm/s",
+	"Start Delay s",
+	"Distance mm",
+	"Radius mm",
+	"Weld Length mm",
+	"< ####.## >",
+	"G-code",
+};
+
+/* What fills the #s of a screen */
+enum { SRC_NONE, SRC_PRG, SRC_VALUE, SRC_COUNTDOWN, SRC_PRE_START, SRC_TYPE };
+
+/* When a state shows its other title */
+enum { ALT_NONE, ALT_BAD_CRC, ALT_ROTARY };
 
+/* What is done on a key, see menuAction() */
+enum { ACT_NONE, ACT_PRG_UP, ACT_PRG_DOWN, ACT_OPEN, ACT_CLOSE,
+       ACT_COUNTDOWN, ACT_COUNTDOWN_TICK, ACT_PRE_START_TICK, ACT_RUNNING,
+       ACT_REWIND, ACT_REWINDING, ACT_TYPE_UP, ACT_TYPE_DOWN, ACT_TYPE_DONE,
+       ACT_VALUE_UP, ACT_VALUE_DOWN, ACT_DISCARD, ACT_SAVE,
+       ACT_IDLE, ACT_GCODE };
 
-/* map State to Program_s index */
-uint8_t stateVal()
+/* Which program types a state is shown for. Moving onto a state that
+   isn't shown carries on the same way to the next one that is */
+#define FOR_ALL    0xff
+#define FOR_LINEAR _BV(PRG_LINEAR)
+#define FOR_ROTARY _BV(PRG_ROTARY)
+
+/* Each key's entry is indexed by its BTN_ code, BTN_NONE for a pass
+   with no key */
+#define MNU_KEYS (BTN_NONE + 1)
+#define MNU_SAME 0xff
+
+struct MenuState {
+	uint8_t next[MNU_KEYS];		/* State after each key, or MNU_SAME */
+	uint8_t action[MNU_KEYS];	/* Done on each key, after moving */
+	uint8_t title;
+	uint8_t altTitle;		/* Shown instead when alt holds */
+	uint8_t alt;
+	uint8_t line2;
+	uint8_t source;			/* What fills the #s */
+	uint8_t value;			/* Program_s value of an edit state */
+	uint8_t types;
+};
+
+#define S MNU_SAME
+#define N ACT_NONE
+/* Keys in the order SELECT, LEFT, RIGHT, UP, DOWN, none */
+const MenuState menu[MNU_STATES] PROGMEM = {
+	/* MNU_SELECT_PRG */
+	{ { S, S, S, S, S, S },
+	  { N, N, ACT_OPEN, ACT_PRG_UP, ACT_PRG_DOWN, ACT_IDLE },
+	  LBL_PROGRAM, LBL_BAD_CRC, ALT_BAD_CRC, LBL_SELECT_PRG, SRC_PRG, 0, FOR_ALL },
+	/* MNU_SELECT_RUN */
+	{ { MNU_RUN_COUNTDOWN, MNU_SELECT_PRG, MNU_SELECT_EDIT, S, S, S },
+	  { ACT_COUNTDOWN, N, N, N, N, ACT_IDLE },
+	  LBL_PROGRAM, LBL_BAD_CRC, ALT_BAD_CRC, LBL_SELECT_RUN, SRC_PRG, 0, FOR_ALL },
+	/* MNU_SELECT_EDIT */
+	{ { MNU_EDIT_TYPE, S, S, S, S, S },
+	  { N, ACT_CLOSE, N, N, N, ACT_IDLE },
+	  LBL_PROGRAM, LBL_BAD_CRC, ALT_BAD_CRC, LBL_SELECT_EDIT, SRC_PRG, 0, FOR_ALL },
+	/* MNU_RUN_COUNTDOWN */
+	{ { S, S, S, S, S, S },
+	  { ACT_COUNTDOWN_TICK, ACT_COUNTDOWN_TICK, ACT_COUNTDOWN_TICK,
+	    ACT_COUNTDOWN_TICK, ACT_COUNTDOWN_TICK, ACT_COUNTDOWN_TICK },
+	  LBL_COUNTDOWN, 0, ALT_NONE, LBL_BLANK, SRC_COUNTDOWN, 0, FOR_ALL },
+	/* MNU_RUN_PRE_START */
+	{ { S, S, S, S, S, S },
+	  { ACT_PRE_START_TICK, ACT_PRE_START_TICK, ACT_PRE_START_TICK,
+	    ACT_PRE_START_TICK, ACT_PRE_START_TICK, ACT_PRE_START_TICK },
+	  LBL_PRE_START, 0, ALT_NONE, LBL_BLANK, SRC_PRE_START, 0, FOR_ALL },
+	/* MNU_RUNNING, any key aborts */
+	{ { S, S, S, S, S, S },
+	  { ACT_RUNNING, ACT_RUNNING, ACT_RUNNING,
+	    ACT_RUNNING, ACT_RUNNING, ACT_RUNNING },
+	  LBL_RUNNING, 0, ALT_NONE, LBL_ABORT, SRC_NONE, 0, FOR_ALL },
+	/* MNU_SELECT_REWIND */
+	{ { MNU_REWIND, S, MNU_SELECT_RETURN, S, S, S },
+	  { ACT_REWIND, N, N, N, N, N },
+	  LBL_FINISHED, 0, ALT_NONE, LBL_REWIND, SRC_NONE, 0, FOR_ALL },
+	/* MNU_SELECT_RETURN */
+	{ { MNU_RETURN, MNU_SELECT_REWIND, S, S, S, S },
+	  { N, N, N, N, N, N },
+	  LBL_FINISHED, 0, ALT_NONE, LBL_RETURN, SRC_NONE, 0, FOR_ALL },
+	/* MNU_REWIND */
+	{ { S, S, S, S, S, S },
+	  { ACT_REWINDING, ACT_REWINDING, ACT_REWINDING,
+	    ACT_REWINDING, ACT_REWINDING, ACT_REWINDING },
+	  LBL_BLANK, 0, ALT_NONE, LBL_BLANK, SRC_NONE, 0, FOR_ALL },
+	/* MNU_RETURN */
+	{ { MNU_SELECT_RUN, MNU_SELECT_RUN, MNU_SELECT_RUN,
+	    MNU_SELECT_RUN, MNU_SELECT_RUN, MNU_SELECT_RUN },
+	  { N, N, N, N, N, N },
+	  LBL_BLANK, 0, ALT_NONE, LBL_BLANK, SRC_NONE, 0, FOR_ALL },
+	/* MNU_EDIT_TYPE */
+	{ { MNU_EDIT_STEPS, MNU_EDIT_SAVE_NO, MNU_EDIT_STEPS, S, S, S },
+	  { ACT_TYPE_DONE, N, ACT_TYPE_DONE, ACT_TYPE_UP, ACT_TYPE_DOWN, N },
+	  LBL_TYPE, 0, ALT_NONE, LBL_BLANK, SRC_TYPE, 0, FOR_ALL },
+	/* MNU_EDIT_STEPS */
+	{ { S, MNU_EDIT_TYPE, MNU_EDIT_SPEED, S, S, S },
+	  { N, N, N, ACT_VALUE_UP, ACT_VALUE_DOWN, N },
+	  LBL_STEPS_MM, LBL_STEPS_REV, ALT_ROTARY, LBL_VALUE, SRC_VALUE, VAL_STEPS, FOR_ALL },
+	/* MNU_EDIT_SPEED */
+	{ { S, MNU_EDIT_STEPS, MNU_EDIT_PRE_START, S, S, S },
+	  { N, N, N, ACT_VALUE_UP, ACT_VALUE_DOWN, N },
+	  LBL_SPEED, 0, ALT_NONE, LBL_VALUE, SRC_VALUE, VAL_SPEED, FOR_ALL },
+	/* MNU_EDIT_PRE_START */
+	{ { S, MNU_EDIT_SPEED, MNU_EDIT_LENGTH, S, S, S },
+	  { N, N, N, ACT_VALUE_UP, ACT_VALUE_DOWN, N },
+	  LBL_START_DELAY, 0, ALT_NONE, LBL_VALUE, SRC_VALUE, VAL_PRE_START, FOR_ALL },
+	/* MNU_EDIT_LENGTH */
+	{ { S, MNU_EDIT_PRE_START, MNU_EDIT_RADIUS, S, S, S },
+	  { N, N, N, ACT_VALUE_UP, ACT_VALUE_DOWN, N },
+	  LBL_LENGTH, 0, ALT_NONE, LBL_VALUE, SRC_VALUE, VAL_LENGTH, FOR_LINEAR },
+	/* MNU_EDIT_RADIUS */
+	{ { S, MNU_EDIT_LENGTH, MNU_EDIT_CIRCUMFERENCE, S, S, S },
+	  { N, N, N, ACT_VALUE_UP, ACT_VALUE_DOWN, N },
+	  LBL_RADIUS, 0, ALT_NONE, LBL_VALUE, SRC_VALUE, VAL_RADIUS, FOR_ROTARY },
+	/* MNU_EDIT_CIRCUMFERENCE */
+	{ { S, MNU_EDIT_RADIUS, MNU_EDIT_SAVE_NO, S, S, S },
+	  { N, N, N, ACT_VALUE_UP, ACT_VALUE_DOWN, N },
+	  LBL_CIRCUMFERENCE, 0, ALT_NONE, LBL_VALUE, SRC_VALUE, VAL_CIRCUMFERENCE, FOR_ROTARY },
+	/* MNU_EDIT_SAVE_NO */
+	{ { MNU_SELECT_PRG, S, MNU_EDIT_SAVE_YES, S, S, S },
+	  { ACT_DISCARD, N, N, N, N, N },
+	  LBL_SAVE, 0, ALT_NONE, LBL_SAVE_NO, SRC_NONE, 0, FOR_ALL },
+	/* MNU_EDIT_SAVE_YES */
+	{ { MNU_SELECT_PRG, MNU_EDIT_SAVE_NO, S, S, S, S },
+	  { ACT_SAVE, N, N, N, N, N },
+	  LBL_SAVE, 0, ALT_NONE, LBL_SAVE_YES, SRC_NONE, 0, FOR_ALL },
+	/* MNU_GCODE, running lines from Serial, any key aborts */
+	{ { S, S, S, S, S, S },
+	  { ACT_GCODE, ACT_GCODE, ACT_GCODE, ACT_GCODE, ACT_GCODE, ACT_GCODE },
+	  LBL_GCODE, 0, ALT_NONE, LBL_ABORT, SRC_NONE, 0, FOR_ALL },
+};
+#undef S
+#undef N
+
+
+
+/* Steps per mm of travel. Rotary programs store steps per revolution,
+   so this is worked out at the surface of the work from the radius */
+float stepsPerMm()
 {
-	switch( state )
+	if (Program.P.type == PRG_ROTARY)
 	{
-		case MNU_EDIT_STEPS: 
-			return VAL_STEPS;
-		case MNU_EDIT_SPEED: 
-			return VAL_SPEED;
-		case MNU_EDIT_PRE_START:
-			return VAL_PRE_START;
-       		case MNU_EDIT_LENGTH: 
-			return VAL_LENGTH;
-		case MNU_EDIT_RADIUS: 
-			return VAL_RADIUS;
-		case MNU_EDIT_CIRCUMFERENCE:
-			return VAL_CIRCUMFERENCE;
-		default:
-			return 254;
+		if (Program.P.values[VAL_RADIUS] <= 0)
+			return 0;
+		return Program.P.values[VAL_STEPS] / 
+			(2 * PI * Program.P.values[VAL_RADIUS]);
 	}
+	return Program.P.values[VAL_STEPS];
 }
 
-/* Start a Linear run */
-void startLinear()
+/* Sets the stepper up for a run of length mm, or to rewind to where the
+   run started. The step rate is worked out here once rather than for each
+   step. Returns how long the move should take in us */
+unsigned long planRun(float length)
 {
-	float speed;
+	float speed, spm = stepsPerMm();
 	long pos;
+
+	if (spm <= 0)
+	{
+		stepper.setCurrentPosition(state == MNU_REWIND ? stepper.currentPosition() : 0);
+		return 0;
+	}
 	// mm/s * steps/mm = steps/s
-	speed = Program.P.values[VAL_STEPS] * Program.P.values[VAL_SPEED];
+	speed = spm * Program.P.values[VAL_SPEED];
 	// mm's * steps/mm = steps
-	pos = Program.P.values[VAL_STEPS] * Program.P.values[VAL_LENGTH];
-
+	pos = lround(spm * length);
 
 	stepper.setMaxSpeed(speed);
 	if (state == MNU_REWIND)
@@ -118,32 +326,256 @@ void startLinear()
 	else
 	{
 		stepper.setCurrentPosition(0);
+		StepTimer::resetStats();
 	}
 	stepper.moveTo(pos);
 	stepper.setSpeed(speed);
+	// The first step is taken at the start, and stepping stops on the last.
+	// The interval is as AccelStepper works it out
+	pos = labs(pos - stepper.currentPosition());
+	return pos ? (pos - 1) * (unsigned long)fabs(1000000.0 / speed) : 0;
+}
+
+/* The length of a run of the program. A rotary program's weld length, kept
+   in its circumference value, is along the surface of the work, so it can
+   be part of a turn or several turns */
+float runLength()
+{
+	if (Program.P.type == PRG_ROTARY)
+		return Program.P.values[VAL_CIRCUMFERENCE];
+	return Program.P.values[VAL_LENGTH];
+}
+
+/* Report the speed a run actually achieved, and how well the
+   step timing kept to schedule. Logged, as printing it all here would
+   hold up loop() */
+void reportRun()
+{
+	unsigned long ms = (TIMELINE.measured(TL_MOTION_END) -
+		TIMELINE.measured(TL_MOTION_START)) / 1000;
+	float spm = stepsPerMm();
+	float mm = spm ? stepper.currentPosition() / spm : 0;
+
+	// In tenths of a mm and s, and hundredths of a mm/s
+	LOG(LOG_INFO, LOG_RUN, lround(mm * 10), ms / 100);
+	LOG(LOG_INFO, LOG_RUN_SPEED, ms ? lround(mm * 100000 / ms) : 0,
+		lround(Program.P.values[VAL_SPEED] * 100));
+	LOG(LOG_INFO, LOG_RUN_STEPS, StepTimer::missedDeadlines(),
+		StepTimer::maxLatency());
+	// How far each event of the timeline was from its plan
+	for( uint8_t e = TL_MOTION_START; e < TL_EVENTS && !TIMELINE.aborted(); e++ )
+		LOG(LOG_INFO, LOG_TIMING, e, TIMELINE.late(e));
+}
+
+uint16_t recordAddr(int prg)
+{
+	return sizeof(version) + (prg - 1) * PRG_RECORD;
+}
+
+/* Returns false if rec is corrupt */
+bool checkRecord(const uint8_t *rec)
+{
+	uint8_t i, crc = 0;
+	for( i = 0; i < PRG_RECORD; i++)
+		crc = crc8(crc, rec[i]);
+	return crc == 0 && rec[0] < PRG_LAST;
+}
+
+/* Read the record of slot prg, returns false if it is corrupt */
+bool readRecord(int prg, uint8_t *rec)
+{
+	uint16_t addr = recordAddr(prg);
+	for( uint8_t i = 0; i < PRG_RECORD; i++)
+		rec[i] = EEPROM.read(addr + i);
+	return checkRecord(rec);
+}
+
+/* Set the CRC of rec from the bytes before it */
+void setCRC(uint8_t *rec)
+{
+	uint8_t i, crc = 0;
+	for( i = 0; i < PRG_RECORD - 1; i++)
+		crc = crc8(crc, rec[i]);
+	rec[PRG_RECORD - 1] = crc;
+}
+
+/* Make the record of Program */
+void packRecord(uint8_t *rec)
+{
+	uint8_t v;
+	uint32_t n;
+	float scaled;
+
+	rec[0] = Program.P.type;
+	for( v = 0; v < 5; v++)
+	{
+		// Clamped as a float, as converting one that is negative, NaN or
+		// too big for the integer is undefined
+		scaled = Program.P.values[v] * PRG_SCALE + 0.5;
+		if( !(scaled >= 0) )
+			n = 0;
+		else if( scaled > 0xffffff )
+			n = 0xffffff;
+		else
+			n = scaled;
+		rec[1 + v * 3] = n;
+		rec[2 + v * 3] = n >> 8;
+		rec[3 + v * 3] = n >> 16;
+	}
+	setCRC(rec);
+}
+
+/* Write rec as the record of slot prg.
+   Only write bytes that are different to save wear */
+uint8_t writeRecord(int prg, const uint8_t *rec)
+{
+	uint8_t i, written = 0;
+	uint16_t addr = recordAddr(prg);
+
+	for( i = 0; i < PRG_RECORD; i++)
+	{
+		if( EEPROM.read(addr + i) != rec[i] )
+		{
+			EEPROM.write(addr + i, rec[i]);
+			written++;
+		}
+	}
+	directory[prg - 1] = rec[0];
+	return written;
+}
+
+/* Version 0001 programs are converted a value at a time, as each new
+   record is written over the start of its old one. Each value is first
+   written to a journal above the records of either version, which says
+   how far the conversion got if the power goes. The journal has two
+   entries, written in turn, so one is whole if the other was cut short */
+#define JOURNAL_ENTRY 5	// The step, then the 3 bytes of the value, then a CRC8
+#define JOURNAL_ADDR (1024 - 2 * JOURNAL_ENTRY)
+
+/* Step 1 is value 0 of program 1. Version 0001 held 48 programs, so the
+   steps fit a byte */
+uint8_t journalStep(int prg, uint8_t v)
+{
+	return (prg - 1) * 5 + v + 1;
+}
+
+/* Read the latest whole journal entry into entry, returns its step, or 0
+   if there is none */
+uint8_t readJournal(uint8_t *entry, uint8_t lastStep)
+{
+	uint8_t e, i, crc, step = 0, got[JOURNAL_ENTRY];
+	for( e = 0; e < 2; e++)
+	{
+		crc = 0;
+		for( i = 0; i < JOURNAL_ENTRY; i++)
+		{
+			got[i] = EEPROM.read(JOURNAL_ADDR + e * JOURNAL_ENTRY + i);
+			crc = crc8(crc, got[i]);
+		}
+		if( crc == 0 && got[0] > step && got[0] <= lastStep )
+		{
+			step = got[0];
+			memcpy(entry, got, JOURNAL_ENTRY);
+		}
+	}
+	return step;
 }
 
-/* Start a Rotary run */
-void startRotary()
+/* Write a byte only if it is different to save wear */
+void updateByte(uint16_t addr, uint8_t value)
 {
+	if( EEPROM.read(addr) != value )
+		EEPROM.write(addr, value);
+}
 
+/* Journal then write value v of the new record of prg */
+void convertValue(int prg, uint8_t v, const uint8_t *bytes)
+{
+	uint8_t i, crc = 0, entry[JOURNAL_ENTRY];
+	uint16_t addr = JOURNAL_ADDR + (journalStep(prg, v) & 1) * JOURNAL_ENTRY;
 
+	entry[0] = journalStep(prg, v);
+	memcpy(entry + 1, bytes, 3);
+	for( i = 0; i < JOURNAL_ENTRY - 1; i++)
+		crc = crc8(crc, entry[i]);
+	entry[JOURNAL_ENTRY - 1] = crc;
+	for( i = 0; i < JOURNAL_ENTRY; i++)
+		updateByte(addr + i, entry[i]);
+	for( i = 0; i < 3; i++)
+		updateByte(recordAddr(prg) + 1 + v * 3 + i, bytes[i]);
+}
+
+/* Convert the programs saved by version 0001, or carry on converting
+   them. Writing a value only overwrites programs before it, and old
+   values of its own program up to its own, so the values after it can
+   still be read after a restart. Empty and unreadable programs convert
+   to blank records. initEEPROM() saves the new version after this */
+void migrateEEPROM()
+{
+	int oldPrgs = (1024 - sizeof(version1)) / sizeof(Program);
+	uint16_t i, addr;
+	uint8_t rec[PRG_RECORD], entry[JOURNAL_ENTRY], done, v;
+
+	lcd.println("Converting");
+	done = readJournal(entry, journalStep(oldPrgs, 4));
+	for( curPrg = 1; curPrg <= maxPrgs; curPrg++)
+	{
+		if( curPrg <= oldPrgs && done > journalStep(curPrg, 4) )
+			continue;
+		addr = (curPrg - 1) * sizeof(Program) + sizeof(version1);
+		for( i = 0; i < sizeof(Program); i++)
+			Program.C[i] = (curPrg <= oldPrgs) ? EEPROM.read(addr + i) : 0;
+		v = 0;
+		if( curPrg <= oldPrgs && done >= journalStep(curPrg, 0) )
+		{
+			// Cut short. The value being written is written again
+			// from the journal, and the type is in the new record,
+			// as the old one may have been overwritten
+			v = done - journalStep(curPrg, 0);
+			convertValue(curPrg, v++, entry + 1);
+			Program.P.type = EEPROM.read(recordAddr(curPrg));
+		}
+		if( Program.P.type == PRG_EMPTY || Program.P.type >= PRG_LAST )
+			memset(&Program, 0, sizeof(Program));
+		packRecord(rec);
+		if( curPrg > oldPrgs )
+		{
+			writeRecord(curPrg, rec);
+			continue;
+		}
+		if( v == 0 )
+			updateByte(recordAddr(curPrg), rec[0]);
+		for( ; v < 5; v++)
+			convertValue(curPrg, v, rec + 1 + v * 3);
+		// Written whole, then the CRC is made from what was written
+		readRecord(curPrg, rec);
+		setCRC(rec);
+		writeRecord(curPrg, rec);
+	}
+	curPrg = 1;
+	LOG(LOG_INFO, LOG_CONVERTED, 0, 0);
 }
 
 /* Erase EEPROM if version mismatch */
 void initEEPROM()
 {
-	uint8_t t, diff=0;
+	uint8_t t, diff=0, old=0;
 	uint16_t i;
-	// compare stored version to ours
+	// compare stored version to ours, and to the one we can convert
 	for( i = 0; i < sizeof(version); i++)
 	{
 		t = EEPROM.read(i);
 		if( t != version[i] )
 			diff++;
+		if( t != version1[i] )
+			old++;
 	}
 			
-	if( diff > 0 ) // mis match
+	if( diff > 0 && old == 0 )
+	{
+		migrateEEPROM();
+	}
+	else if( diff > 0 ) // mis match
 	{
 		lcd.println("Erasing EEPROM");
 	
@@ -154,8 +586,11 @@ void initEEPROM()
 			if( t > 0) // only erase if not already 0
 				EEPROM.write(i,0);
 		}
+		LOG(LOG_INFO, LOG_ERASED, 0, 0);
+	}
 
-
+	if( diff > 0 )
+	{
 		// Finally save our version 
 		for( i = 0; i < sizeof(version); i++)
 		{
@@ -166,157 +601,429 @@ void initEEPROM()
 	}
 }
 
-/* load Program from curPrg slot in eeprom */
+/* Read the type of every program into the directory */
+void readDirectory()
+{
+	uint8_t rec[PRG_RECORD];
+	for( int prg = 1; prg <= maxPrgs; prg++)
+		directory[prg - 1] = readRecord(prg, rec) ? rec[0] : PRG_BAD;
+}
+
+/* load Program from curPrg slot in eeprom.
+   A corrupt slot loads as an empty program */
 void loadProgram()
 {
-	uint16_t addr, i;
-	addr = (curPrg * sizeof(Program)) - sizeof(Program) + sizeof(version);
+	uint8_t rec[PRG_RECORD], v;
 
-	for( i = 0; i < sizeof(Program); i++)
+	LOG(LOG_DEBUG, LOG_LOAD, curPrg, 0);
+	if( !readRecord(curPrg, rec) )
 	{
-		Serial.print("Load ");
-		Program.C[i]=EEPROM.read(addr + i);
-		Serial.print(Program.C[i]);
-		Serial.print(" from ");
-		Serial.println(addr + i);
+		LOG(LOG_ERROR, LOG_BAD_CRC, curPrg, 0);
+		memset(rec, 0, sizeof(rec));
+	}
+	Program.P.type = rec[0];
+	for( v = 0; v < 5; v++)
+	{
+		Program.P.values[v] = (rec[1 + v * 3] |
+			((uint16_t)rec[2 + v * 3] << 8) |
+			((uint32_t)rec[3 + v * 3] << 16)) / (float)PRG_SCALE;
 	}
 }
 
-/* save Program into curPrg slot in eeprom 
-   Only write bytes that are different to save wear */
+/* save Program into curPrg slot in eeprom */
 void saveProgram()
 {
-	uint16_t addr, i; 
-	char t;
-	addr = (curPrg * sizeof(Program)) - sizeof(Program) + sizeof(version);
-	for( i = 0; i < sizeof(Program); i++)
-	{
-		Serial.print("Save  ");
-		Serial.print(Program.C[i]);
-		Serial.print(" at ");
-		Serial.print(addr + i);
-		t = EEPROM.read(addr + i);
-		if (t != Program.C[i])
-		{
-			Serial.println("!");
-			EEPROM.write(addr + i, Program.C[i]);
-		}
-		else
-		{
-			Serial.println(".");
-		}
-	}
+	uint8_t rec[PRG_RECORD], written;
+
+	packRecord(rec);
+	written = writeRecord(curPrg, rec);
+	LOG(LOG_INFO, LOG_SAVE, curPrg, written);
 }
 
-void UpdateLCD()
+/* Does an action from the menu table, after state has moved to the
+   key's next state. Returns the state to be in after it */
+uint8_t menuAction(uint8_t action)
 {
-	// Don't wast time updating the lcd if there is no change
-	if (!updateLCD) 
-		return;
-	// Display top line
-	lcd.setCursor(0,0);
-	switch (state)
+	uint8_t value = pgm_read_byte(&menu[state].value);
+
+	switch( action )
 	{
-		case MNU_SELECT_PRG:
-		case MNU_SELECT_RUN:
-		case MNU_SELECT_EDIT:
-			fprintf(&lcdout,"%-16s","Program");
+		case ACT_PRG_UP:
+			curPrg += KEY.HoldMultiplier(10);
+			if( curPrg > maxPrgs) 
+				curPrg = 1;
 			break;
-		case MNU_RUN_COUNTDOWN:
-			fprintf(&lcdout,"Count Down %02d",(countdown / 1000) );
+		case ACT_PRG_DOWN:
+			curPrg -= KEY.HoldMultiplier(10);
+			if( curPrg < 1) 
+				curPrg = maxPrgs;
 			break;
-		case MNU_RUNNING:
-			fprintf(&lcdout,"%-16s","Running");
+		case ACT_OPEN:
+			loadProgram();
+			// Fall through
+		case ACT_CLOSE:
+			return (Program.P.type == PRG_EMPTY) ?
+				MNU_SELECT_EDIT : MNU_SELECT_RUN;
+		case ACT_COUNTDOWN:
+			countdown = 5500; // 5 seconds
 			break;
-		case MNU_RUN_PRE_START:
-			fprintf(&lcdout,"Pre Start %04d", countdown / 100 );
+		case ACT_COUNTDOWN_TICK:
+			updateLCD = 1;
+			if( countdown < 1 ) 
+			{
+				// Relay on now, then the motor starts after the pre start
+				// delay and the relay goes off after it stops, all timed
+				// by Timer1. The countdown is only shown
+				countdown = Program.P.values[VAL_PRE_START] * 1000; // stored in seconds counted in ms
+				TIMELINE.start(Program.P.values[VAL_PRE_START] * 1000000,
+					planRun(runLength()), POST_FLOW * 1000UL);
+				return MNU_RUN_PRE_START;
+			}
 			break;
-		case MNU_SELECT_REWIND:
-		case MNU_SELECT_RETURN:
-			fprintf(&lcdout,"%-16s","Finished");
+		case ACT_PRE_START_TICK:
+			updateLCD = 1;
+			if (key != BTN_NONE)
+			{
+				TIMELINE.abort();
+				return MNU_SELECT_RUN;
+			}
+			if (TIMELINE.next() > TL_MOTION_START)
+				return MNU_RUNNING;
 			break;
-		case MNU_EDIT_TYPE:
-			fprintf(&lcdout,"%-16s","Type");
+		case ACT_RUNNING:
+			if (key != BTN_NONE)
+				TIMELINE.abort();
+			if (!TIMELINE.running())
+			{
+				reportRun();
+				return MNU_SELECT_REWIND;
+			}	
 			break;
-		case MNU_EDIT_SAVE_YES:
-		case MNU_EDIT_SAVE_NO:
-			fprintf(&lcdout,"%-16s","Save Changes?");
+		case ACT_REWIND:
+			// A one step run takes no time, but still has a step to go back
+			planRun(runLength());
+			if (stepper.distanceToGo())
+				StepTimer::begin(&stepper);
 			break;
-		case MNU_EDIT_STEPS: 
-			fprintf(&lcdout,"%-16s","Steps /mm");
+		case ACT_REWINDING:
+			if (!StepTimer::running())
+				return MNU_SELECT_RUN;
 			break;
-		case MNU_EDIT_SPEED: 
-			fprintf(&lcdout,"%-16s","Speed mm/s");
+		case ACT_TYPE_UP:
+			Program.P.type++;
+			if (Program.P.type == PRG_LAST)
+				Program.P.type=PRG_EMPTY;
+			break; 
+		case ACT_TYPE_DOWN:  
+			if (Program.P.type == PRG_EMPTY)
+				Program.P.type = PRG_LAST;
+			Program.P.type--;
+			break; 
+		case ACT_TYPE_DONE:
+			if( Program.P.type == PRG_EMPTY )
+				return MNU_EDIT_TYPE;
 			break;
-		case MNU_EDIT_PRE_START:
-			fprintf(&lcdout,"%-16s","Start Delay s");
+		case ACT_VALUE_UP:
+		case ACT_VALUE_DOWN:
+			if( action == ACT_VALUE_UP )
+				Program.P.values[value] += 0.01 * KEY.HoldMultiplier();
+			else
+				Program.P.values[value] -= 0.01 * KEY.HoldMultiplier();
+			if( Program.P.values[value] < 0.0 )
+				Program.P.values[value] = 9999.99;
+			else if( Program.P.values[value] >= 10000)
+				Program.P.values[value] = 0;
 			break;
-       		case MNU_EDIT_LENGTH: 
-			fprintf(&lcdout,"%-16s","Distance mm");
+		case ACT_DISCARD:
+			loadProgram();
 			break;
-		case MNU_EDIT_RADIUS: 
-			fprintf(&lcdout,"%-16s","Radius mm");
+		case ACT_SAVE:
+			saveProgram();
 			break;
-		case MNU_EDIT_CIRCUMFERENCE:
-			fprintf(&lcdout,"%-16s","Circumference mm");
+		case ACT_IDLE:
+			// G-code runs with the selected program's steps/mm. Browsing
+			// doesn't load the programs it passes, so load it now
+			if( GCODE.pending() )
+			{
+				if( state == MNU_SELECT_PRG )
+					loadProgram();
+				return MNU_GCODE;
+			}
 			break;
+		case ACT_GCODE:
+			if( stepsPerMm() <= 0 )
+				GCODE.abort(F("no steps/mm"));
+			else if( key != BTN_NONE )
+				GCODE.abort();
+			else if( GCODE.run(stepsPerMm()) )
+				break;
+			return MNU_SELECT_PRG;
+	}
+	return state;
+}
 
+/* Draws a line of the LCD from a label, with the screen's number in
+   its #s */
+void drawLine(uint8_t row, uint8_t label, const MenuState &m)
+{
+	char line[LCD_COLS + 1], *p, *point;
+	uint8_t width;
+	float number = 0;
 
-			
+	fmtStr_P(line, labels[label], LCD_COLS);
+	line[LCD_COLS] = '\0';
+	if( (p = strchr(line, '#')) )
+	{
+		switch( m.source )
+		{
+			case SRC_PRG:
+				number = curPrg;
+				break;
+			case SRC_VALUE:
+				number = Program.P.values[m.value];
+				break;
+			case SRC_COUNTDOWN:
+				number = countdown / 1000;
+				break;
+			case SRC_PRE_START:
+				number = countdown / 100;
+				break;
+		}
+		width = strspn(p, "#.");
+		point = (char *)memchr(p, '.', width);
+		fmtFixed(p, number, width, point ? width - (point - p) - 1 : 0);
 	}
+	screen.setCursor(0, row);
+	screen.print(line);
+}
+
+void UpdateLCD()
+{
+	MenuState m;
+	uint8_t title;
 
-	// Display 2nd line
-	lcd.setCursor(0,1);
-	switch (state) 
+	// Don't wast time updating the lcd if there is no change
+	if (!updateLCD) 
+		return;
+	memcpy_P(&m, &menu[state], sizeof(m));
+	title = m.title;
+	if( (m.alt == ALT_BAD_CRC && directory[curPrg - 1] == PRG_BAD) ||
+	    (m.alt == ALT_ROTARY && Program.P.type == PRG_ROTARY) )
+		title = m.altTitle;
+	drawLine(0, title, m);
+	drawLine(1, (m.source == SRC_TYPE) ? LBL_EMPTY + Program.P.type : m.line2, m);
+	updateLCD = 0;
+}
+
+
+/* System commands, lines from Serial starting with $. $P prints the
+   loop() profile and task times, $R resets them */
+void systemCommand(const char *line)
+{
+	switch (toupper(line[0]))
 	{
-		case MNU_SELECT_PRG:
-			fprintf(&lcdout," <%02d> Run Edit ",curPrg);
+		case 'P':
+			PROFILE.dump(Serial);
+			TASKS.dump(Serial);
 			break;
-		case MNU_SELECT_RUN:
-			fprintf(&lcdout,"  %02d <Run>Edit ",curPrg);
+		case 'R':
+			PROFILE.reset();
+			TASKS.reset();
 			break;
-		case MNU_SELECT_EDIT:
-			fprintf(&lcdout,"  %02d  Run<Edit>",curPrg);
-			break;
-		case MNU_RUN_PRE_START:
-		case MNU_RUN_COUNTDOWN:
-			fprintf(&lcdout,"%-16s"," ");
-			break;
-		case MNU_RUNNING:
-			fprintf(&lcdout,"%-16s","<Abort>");
-			break;
-		case MNU_SELECT_REWIND:
-			fprintf(&lcdout,"<Rewind> Return  ");
-			break;
-		case MNU_SELECT_RETURN:
-			fprintf(&lcdout," Rewind <Return> ");
-			break;
-		case MNU_EDIT_TYPE:
-			fprintf(&lcdout,"%-16s",PRG_TYPES[(int)Program.C[0]]);
-			break;
-		case MNU_EDIT_SAVE_YES:
-			fprintf(&lcdout,"%-16s"," NO <YES>");
+	}
+}
+
+/* Whether the menu is on a Program screen, so nothing is running or
+   being edited */
+bool idle()
+{
+	return state == MNU_SELECT_PRG || state == MNU_SELECT_RUN ||
+		state == MNU_SELECT_EDIT;
+}
+
+void sendStatus()
+{
+	uint8_t data[8], oldSREG = SREG;
+	long pos;
+
+	cli(); // StepTimer moves the motor from its interrupt
+	pos = stepper.currentPosition();
+	SREG = oldSREG;
+	data[0] = state;
+	data[1] = curPrg;
+	data[2] = directory[curPrg - 1];	// Program is only loaded on opening it
+	data[3] = (StepTimer::running() ? LINK_RUNNING : 0) |
+		(digitalRead(pRELAY) ? LINK_RELAY : 0) |
+		(GCODE.pending() ? LINK_GCODE : 0);
+	for( uint8_t i = 0; i < 4; i++)
+		data[4 + i] = pos >> (8 * i);
+	LINK.send(LINK_STATUS, data, sizeof(data));
+}
+
+/* Sends the records of a LINK_READ while Serial has room for them,
+   so a read of every program doesn't hold up loop() */
+void sendRecords()
+{
+	uint8_t data[1 + PRG_RECORD];
+
+	while( readPrg && readPrg <= readLast && LINK.room(sizeof(data)) )
+	{
+		data[0] = readPrg;
+		readRecord(readPrg++, data + 1);
+		LINK.send(LINK_RECORD, data, sizeof(data));
+		readSent++;
+	}
+	if( readPrg > readLast && LINK.room(2) )
+	{
+		LINK.reply(LINK_ACK, LINK_READ, readSent);
+		readPrg = 0;
+	}
+}
+
+/* Writes a byte of a LINK_WRITE's record each pass, as each byte written
+   holds up loop() for 3.3ms, skipping those that are already right. Waits
+   while a key has left the Program screens. Once it is all written, the
+   program is reloaded if it is showing and the write is answered */
+void writeRecords()
+{
+	uint16_t addr;
+
+	if( !writePrg || !idle() )
+		return;
+	addr = recordAddr(writePrg);
+	while( writeNext < PRG_RECORD &&
+	       EEPROM.read(addr + writeNext) == writeRec[writeNext] )
+		writeNext++;
+	if( writeNext < PRG_RECORD )
+	{
+		EEPROM.write(addr + writeNext, writeRec[writeNext]);
+		writeNext++;
+		writeCount++;
+		return;
+	}
+	if( !LINK.room(2) )
+		return;
+	directory[writePrg - 1] = writeRec[0];
+	if( writeCount )
+		LOG(LOG_INFO, LOG_SAVE, writePrg, writeCount);
+	if( writePrg == curPrg )
+	{
+		if( state == MNU_SELECT_PRG )
+			loadProgram();
+		else
+			state = menuAction(ACT_OPEN);
+		updateLCD = 1;
+	}
+	LINK.reply(LINK_ACK, LINK_WRITE, writeCount);
+	writePrg = 0;
+}
+
+/* Does a LINK_START, LINK_ABORT or LINK_REWIND as the keys would.
+   Returns why it can't be done, or 0 */
+uint8_t linkControl(uint8_t type, uint8_t prg)
+{
+	switch( type )
+	{
+		case LINK_START:
+			if( directory[prg - 1] == PRG_EMPTY || directory[prg - 1] == PRG_BAD )
+				return LINK_BAD_PRG;
+			if( !idle() || writePrg )
+				return LINK_BUSY;
+			curPrg = prg;
+			loadProgram();
+			state = MNU_RUN_COUNTDOWN;
+			state = menuAction(ACT_COUNTDOWN);
 			break;
-		case MNU_EDIT_SAVE_NO:
-			fprintf(&lcdout,"%-16s","<NO> YES");
+		case LINK_ABORT:
+			if( state == MNU_RUN_COUNTDOWN || state == MNU_RUN_PRE_START )
+			{
+				TIMELINE.abort();
+				state = MNU_SELECT_RUN;
+			}
+			else if( state == MNU_RUNNING )
+			{
+				TIMELINE.abort();
+				state = menuAction(ACT_RUNNING);
+			}
+			else if( state == MNU_REWIND )
+			{
+				StepTimer::end();
+				state = menuAction(ACT_REWINDING);
+			}
+			else if( state == MNU_GCODE )
+			{
+				GCODE.abort();
+				state = MNU_SELECT_PRG;
+			}
 			break;
-		case MNU_EDIT_STEPS: 
-		case MNU_EDIT_SPEED: 
-		case MNU_EDIT_PRE_START:
-       		case MNU_EDIT_LENGTH: 
-		case MNU_EDIT_RADIUS: 
-		case MNU_EDIT_CIRCUMFERENCE:
-			fprintf(&lcdout,"< %07.2f >     ",
-					Program.P.values[stateVal()]);
+		case LINK_REWIND:
+			if( state != MNU_SELECT_REWIND && state != MNU_SELECT_RETURN )
+				return LINK_BUSY;
+			state = MNU_REWIND;
+			state = menuAction(ACT_REWIND);
 			break;
+	}
+	updateLCD = 1;
+	return 0;
+}
 
+/* Frames from the binary protocol, see link.h */
+void linkFrame(uint8_t type, const uint8_t *data, uint8_t length)
+{
+	uint8_t error = 0, prg = length ? data[0] : 0;
+	bool hasPrg = (type == LINK_READ && length == 1) ||
+		type == LINK_WRITE || type == LINK_START;
 
+	if( hasPrg && (prg < 1 || prg > maxPrgs) )
+		error = LINK_BAD_PRG;
+	switch( type )
+	{
+		case LINK_STATUS:
+			sendStatus();
+			return;
+		case LINK_READ:
+			if( length > 1 )
+				error = LINK_BAD_LENGTH;
+			else if( readPrg || writePrg )
+				error = LINK_BUSY;	// A record being written would be sent half done
+			if( error )
+				break;
+			readPrg = length ? prg : 1;
+			readLast = length ? prg : maxPrgs;
+			readSent = 0;
+			sendRecords();
+			return;
+		case LINK_WRITE:
+			if( length != 1 + PRG_RECORD )
+				error = LINK_BAD_LENGTH;
+			else if( !error && !checkRecord(data + 1) )
+				error = LINK_BAD_RECORD;
+			else if( !error && (!idle() || writePrg) )
+				error = LINK_BUSY;
+			if( error )
+				break;
+			// Written by the menu task, which answers once it is done
+			writePrg = prg;
+			memcpy(writeRec, data + 1, PRG_RECORD);
+			writeNext = writeCount = 0;
+			return;
+		case LINK_START:
+		case LINK_ABORT:
+		case LINK_REWIND:
+			if( length != (type == LINK_START) )
+				error = LINK_BAD_LENGTH;
+			else if( !error )
+				error = linkControl(type, prg);
+			if( error )
+				break;
+			LINK.reply(LINK_ACK, type, state);
+			return;
+		default:
+			error = LINK_UNKNOWN;
 	}
-
-	updateLCD = 0;
+	LINK.reply(LINK_NAK, type, error);
 }
 
-
 void setup()
 {
   digitalWrite(pRELAY,LOW);
@@ -325,293 +1032,113 @@ void setup()
   pinMode(pDIR,OUTPUT);
   digitalWrite(A5,LOW);
   pinMode(pDIR,OUTPUT);
+  // Lower STEP on the next timer tick rather than busy waiting in the interrupt,
+  // and give the driver time to see DIR change before stepping
+  stepper.setNonBlockingPulse(true);
+  stepper.setDirectionSetupTime(5);
+  // Make up steps held back by other interrupts, so the weld keeps to its speed,
+  // but not after a stall long enough that the burst could lose steps
+  stepper.setMaxCatchUp(8);
   lcd.begin(16, 2);
-/* To allow printf to lcd */
-  fdev_setup_stream (&lcdout, lcd_putchar, NULL, _FDEV_SETUP_WRITE);
   lcd.clear();
   Serial.begin(9600);
+  // Read the keypad from the ADC interrupt, so a pass of loop() doesn't
+  // wait for a conversion
+  KEY.beginScan();
   initEEPROM();
+  readDirectory();
   loadProgram();
   UpdateLCD();
+
+  // In priority order. Stepping is done by the StepTimer interrupt, so
+  // the tasks that can wait hold off until there is a gap between steps
+  TASKS.setSlack(StepTimer::slack);
+  TASKS.add(F("keypad"), keypadTask, 0, 0, false);
+  TASKS.add(F("menu"), menuTask, 0, 0, false);
+  TASKS.add(F("lcd"), lcdTask, 0, 350, true);
+  GCODE.setSystem(systemCommand);
+  LINK.setHandler(linkFrame);
+  TASKS.add(F("serial"), serialTask, 20, 300, true);
+  TASKS.add(F("log"), logTask, 10, 200, true);
 }
 
-void loop() {
+/* The keypad task. The key is used by the menu task after it */
+void keypadTask()
+{
+	key = KEY.read();
+	PROFILE.mark(PRF_KEYPAD);
+}
+
+/* The menu task. Moves through the menu table on each key, or on
+   BTN_NONE for a pass with no key */
+void menuTask()
+{
 	static int ms = 0;
-	static uint8_t oldkey = BTN_NONE;
 	static unsigned long tm_last = 0;
-	uint8_t key = BTN_NONE;
 	unsigned long tm_now = millis();
+	uint8_t old = state, next, action;
 
 	ms = (tm_now - tm_last);
 	countdown -= ms;
-/*
-	ms += (tm_now - tm_last);
-	if( ms > 999 )
-	{
-		if( countdown > 0)
-			countdown--;	
 
-		ms -= 1000;
-	}
-*/
-	key = KEY.read();
-	switch( state )
+	next = pgm_read_byte(&menu[state].next[key]);
+	action = pgm_read_byte(&menu[state].action[key]);
+	if( next != MNU_SAME )
+		state = next;
+	if( action != ACT_NONE )
+		state = menuAction(action);
+	// Skip states that aren't shown for this type of program
+	while( !(pgm_read_byte(&menu[state].types) & _BV(Program.P.type)) )
+		state += (state > old) ? 1 : -1;
+
+	if( state != old || (key != BTN_NONE && (next != MNU_SAME || action != ACT_NONE)) )
+		updateLCD = 1;
+	writeRecords();
+	PROFILE.mark(PRF_STATE);
+	key = BTN_NONE;
+	tm_last = tm_now;
+}
+
+/* The LCD task, draws any change into the screen buffer and sends a
+   little of it to the LCD */
+void lcdTask()
+{
+	UpdateLCD();
+	screen.update();
+	PROFILE.mark(PRF_LCD);
+}
+
+/* The serial task, reads G-code, system commands and frames. Frames are
+   read as they arrive, but text only while G-code has room for a line */
+void serialTask()
+{
+	int c;
+
+	GCODE.poll();
+	while( (c = Serial.peek()) >= 0 )
 	{
-		case MNU_SELECT_PRG:
-			switch( key )
-			{
-				case BTN_UP:
-					curPrg += KEY.HoldMultiplier(10);
-					if( curPrg > maxPrgs) 
-						curPrg = 1;
-					loadProgram();
-					updateLCD = 1;
-					break;
-				case BTN_DOWN:
-					curPrg -= KEY.HoldMultiplier(10);
-					if( curPrg < 1) 
-						curPrg = maxPrgs;
-					loadProgram();
-					updateLCD = 1;
-					break;
-				case BTN_RIGHT:
-					updateLCD = 1;
-					if( Program.P.type == PRG_EMPTY)
-						state = MNU_SELECT_EDIT;
-					else
-						state = MNU_SELECT_RUN;
-					break;
-			}
-			break;
-		case MNU_SELECT_RUN:
-			switch( key )
-			{
-				case BTN_LEFT:
-					updateLCD = 1;
-					state = MNU_SELECT_PRG;
-					break;
-				case BTN_RIGHT:
-					updateLCD = 1;
-					state = MNU_SELECT_EDIT;
-					break;
-				case BTN_SELECT:
-					updateLCD = 1;
-					state = MNU_RUN_COUNTDOWN;
-					countdown = 5500; // 5 seconds
-					break;
-			}
-			break;
-		case MNU_SELECT_EDIT:
-			switch( key )
-			{
-				case BTN_LEFT:
-					updateLCD = 1;
-					if( Program.P.type == PRG_EMPTY)
-						state = MNU_SELECT_PRG;
-					else
-						state = MNU_SELECT_RUN;
-					break;
-				case BTN_SELECT:
-					updateLCD = 1;
-					state = MNU_EDIT_TYPE;
-					break;
-			}
-			break;
-		case MNU_RUN_COUNTDOWN:
-			updateLCD = 1;
-			if( countdown < 1 ) 
-			{
-				// Turn relay on 
-				digitalWrite(pRELAY,HIGH);
-				state = MNU_RUN_PRE_START;
-				countdown = Program.P.values[VAL_PRE_START] * 1000; // stored in seconds counted in ms
-			}
-			break;
-		case MNU_RUN_PRE_START:
-			updateLCD = 1;
-			if( countdown < 1) 
-			{
-				if(Program.P.type == PRG_LINEAR) 
-				{
-					startLinear();
-					state = MNU_RUNNING;
-				} 
-				else if (Program.P.type == PRG_ROTARY)
-				{
-					startRotary();
-					state = MNU_RUNNING;
-				}
-					
-digitalWrite(pRELAY,LOW);
-			}
-			break;
-		case MNU_RUNNING:
-			stepper.runSpeed();
-			if (key != BTN_NONE)
-			{
-				state = MNU_SELECT_REWIND;
-				updateLCD = 1;
-			} 
-			if (stepper.distanceToGo() == 0)
-			{
-				state = MNU_SELECT_REWIND;
-				updateLCD = 1;
-			}	
-			break;
-		case MNU_SELECT_REWIND:
-			switch( key )
-			{
-				case BTN_RIGHT:
-					state = MNU_SELECT_RETURN;
-					updateLCD = 1;
-					break;
-				case BTN_SELECT:
-					state = MNU_REWIND;
-					if(Program.P.type == PRG_LINEAR) 
-					{
-						startLinear();
-					}	 
-					else if (Program.P.type == PRG_ROTARY)
-					{
-						startRotary();
-					}
-					
-					updateLCD = 1;
-					break;
-			}
-			break;
-		case MNU_SELECT_RETURN:
-			switch( key )
-			{
-				case BTN_LEFT:
-					updateLCD = 1;
-					state = MNU_SELECT_REWIND;
-					break;
-				case BTN_SELECT:
-					updateLCD = 1;
-					state = MNU_RETURN;
-					break;
-			}
-			break;
-		case MNU_REWIND:
-			stepper.runSpeed();
-			if (stepper.distanceToGo() == 0)
-			{
-				state = MNU_SELECT_RUN;
-				updateLCD = 1;
-			}	
-			break;
-		case MNU_RETURN:
-			updateLCD = 1;
-			state = MNU_SELECT_RUN;
-			break;
-		case MNU_EDIT_TYPE:
-			switch( key )
-			{
-				case BTN_UP:
-					updateLCD = 1;
-					Program.P.type++;
-					if (Program.P.type == PRG_LAST)
-						Program.P.type=PRG_EMPTY;
-					break; 
-				case BTN_DOWN:  
-					updateLCD = 1;
-					if (Program.P.type == PRG_EMPTY)
-						Program.P.type = PRG_LAST;
-					
-					Program.P.type--;
-					break; 
-				case BTN_RIGHT:
-				case BTN_SELECT:
-					updateLCD = 1;
-					if( Program.P.type != PRG_EMPTY )
-						state++;
-					break;
-				case BTN_LEFT:
-					updateLCD = 1;
-					state = MNU_EDIT_SAVE_NO;
-					break;
-					
-			}
+		if( GCODE.held() && !LINK.inFrame() && c != LINK_STX &&
+		    c != '\n' && c != '\r' )
 			break;
+		Serial.read();
+		if( !LINK.add(c) )
+		{
+			GCODE.add(c);
+			GCODE.poll();
+		}
+	}
+	sendRecords();
+}
 
-		case MNU_EDIT_STEPS: 
-		case MNU_EDIT_SPEED: 
-		case MNU_EDIT_PRE_START:
-       		case MNU_EDIT_LENGTH: 
-		case MNU_EDIT_RADIUS: 
-		case MNU_EDIT_CIRCUMFERENCE:
-			switch( key )
-			{
-				case BTN_RIGHT:
-					updateLCD = 1;
-					if (Program.P.type == PRG_ROTARY && 
-						    state == MNU_EDIT_PRE_START)
-						state = MNU_EDIT_RADIUS;
-					else if (Program.P.type == PRG_LINEAR &&
-						       state == MNU_EDIT_LENGTH)
-						state = MNU_EDIT_SAVE_NO;
-					else
-						state++;
-					break;
-				case BTN_LEFT:
-					updateLCD = 1;
-					if (Program.P.type == PRG_ROTARY &&
-						      state == MNU_EDIT_RADIUS)
-						state = MNU_EDIT_PRE_START;
-					else
-						state--;
-					break;
-				case BTN_UP:
-					updateLCD = 1;
-					Program.P.values[stateVal()] += 
-						0.01 * KEY.HoldMultiplier();
-					break;
-				case BTN_DOWN:
-					updateLCD = 1;
-					Program.P.values[stateVal()] -= 
-						0.01 * KEY.HoldMultiplier();
-					break;
-			}
-			if( Program.P.values[stateVal()] < 0.0 )
-				Program.P.values[stateVal()] = 9999.99;
-			else if( Program.P.values[stateVal()] >= 10000)
-				Program.P.values[stateVal()] = 0;
-			break;
-		case MNU_EDIT_SAVE_NO:
-			switch( key )
-			{
-				case BTN_RIGHT:
-					updateLCD = 1;
-					state = MNU_EDIT_SAVE_YES;
-					break;
-				case BTN_SELECT:
-					updateLCD = 1;
-					loadProgram();
-					state = MNU_SELECT_PRG;
-					break;
-			}
-			break;
-		case MNU_EDIT_SAVE_YES:
-			switch( key )
-			{
-				case BTN_LEFT:
-					updateLCD = 1;
-					state = MNU_EDIT_SAVE_NO;
-					break;
-				case BTN_SELECT:
-					updateLCD = 1;
-					saveProgram();
-					state = MNU_SELECT_PRG;
-					break;
-			}
-			break;
-		break;
-			
+void logTask()
+{
+	Log.poll();
+}
 
-	}
-	UpdateLCD();
-	tm_last = tm_now;
+void loop() {
+	PROFILE.begin(state);
+	TASKS.run();
+	PROFILE.end();
 }
 
 
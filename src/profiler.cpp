@@ -0,0 +1,101 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+#include "profiler.h"
+
+Profiler::Profiler() {
+	reset();
+}
+
+void Profiler::reset() {
+	m_state = 0;
+	memset(m_hist, 0, sizeof(m_hist));
+	memset(m_worst, 0, sizeof(m_worst));
+}
+
+void Profiler::begin(uint8_t state) {
+	m_state = (state < PRF_STATES) ? state : PRF_STATES - 1;
+	m_start = m_last = micros();
+}
+
+/* Saturates, rather than wrap a slow time round to a fast one */
+static uint16_t clip(unsigned long us) {
+	return (us > 0xffff) ? 0xffff : us;
+}
+
+void Profiler::mark(uint8_t phase) {
+	unsigned long now = micros();
+	uint16_t us = clip(now - m_last);
+	m_last = now;
+	if( us > m_worst[m_state][phase] )
+		m_worst[m_state][phase] = us;
+}
+
+void Profiler::end() {
+	unsigned long us = micros() - m_start;
+	uint8_t *hist = m_hist[m_state];
+	uint8_t bucket = 0;
+
+	if( clip(us) > m_worst[m_state][PRF_PHASES] )
+		m_worst[m_state][PRF_PHASES] = clip(us);
+
+	// log2 of the time, counting from the first bucket
+	us >>= PRF_FIRST_BUCKET;
+	while( us && bucket < PRF_BUCKETS - 1 ) {
+		us >>= 1;
+		bucket++;
+	}
+	if( ++hist[bucket] == 0xff ) {
+		for( uint8_t i = 0; i < PRF_BUCKETS; i++ )
+			hist[i] >>= 1;
+	}
+}
+
+/* One line per state that has been profiled, eg
+   S5 max 131 key 115 run 8 lcd 4 us, <128us 200 <256us 3
+   with the worst pass, then the worst of each phase, then the
+   histogram buckets that are not empty, by their upper limits */
+void Profiler::dump(Print &out) {
+	for( uint8_t s = 0; s < PRF_STATES; s++ ) {
+		if( !m_worst[s][PRF_PHASES] )
+			continue;
+		out.print('S');
+		out.print(s);
+		out.print(F(" max "));
+		out.print(m_worst[s][PRF_PHASES]);
+		out.print(F(" key "));
+		out.print(m_worst[s][PRF_KEYPAD]);
+		out.print(F(" run "));
+		out.print(m_worst[s][PRF_STATE]);
+		out.print(F(" lcd "));
+		out.print(m_worst[s][PRF_LCD]);
+		out.print(F(" us"));
+		for( uint8_t b = 0; b < PRF_BUCKETS; b++ ) {
+			if( !m_hist[s][b] )
+				continue;
+			if( b == PRF_BUCKETS - 1 )
+				out.print(F(", >="));
+			else
+				out.print(F(", <"));
+			out.print(1UL << (PRF_FIRST_BUCKET + b - (b == PRF_BUCKETS - 1)));
+			out.print(F("us "));
+			out.print(m_hist[s][b]);
+		}
+		out.println();
+	}
+}
@@ -0,0 +1,55 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef PROFILER_H
+#define PROFILER_H
+#include "Arduino.h"
+#include <inttypes.h>
+
+/* The parts of a pass of loop() that are timed, in order */
+enum { PRF_KEYPAD, PRF_STATE, PRF_LCD, PRF_PHASES };
+
+/* How many menu states can be profiled */
+#define PRF_STATES 20
+
+/* Histogram buckets. Bucket 0 is passes under 128us, and each bucket
+   after is twice as wide, so the last is passes of 32ms or more */
+#define PRF_BUCKETS 10
+#define PRF_FIRST_BUCKET 7
+
+/* Times each pass of loop() and its phases, by the menu state the pass
+   started in. Each state keeps a histogram of whole passes and the worst
+   time of each phase. The histogram counts are 8 bit, and when one fills
+   all the counts for that state are halved, so the shape is kept */
+class Profiler {
+public:
+	Profiler();
+	void begin(uint8_t state);	/* At the start of a pass */
+	void mark(uint8_t phase);	/* At the end of each phase */
+	void end();			/* At the end of the pass */
+	void dump(Print &out);
+	void reset();
+
+private:
+	uint8_t m_state;
+	unsigned long m_start;
+	unsigned long m_last;
+	uint8_t m_hist[PRF_STATES][PRF_BUCKETS];
+	uint16_t m_worst[PRF_STATES][PRF_PHASES + 1]; /* The phases, then the pass */
+};
+
+#endif
@@ -0,0 +1,67 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+#include "Arduino.h"
+#include <inttypes.h>
+
+/* How many tasks can be added */
+#define SCHED_TASKS 6
+
+/* A background task that has waited this long for enough slack runs
+   anyway, so fast stepping can't starve it */
+#define SCHED_MAX_WAIT 100	/* ms */
+
+typedef void (*TaskFunc)();
+
+/* Runs tasks from loop(), highest priority first. Each task has a
+   period and a worst case cost. A background task only runs when the
+   slack function says the next step is at least its cost away, so it
+   doesn't straddle a step. Each task counts its runs, the runs it put
+   off and its worst and total time */
+class Scheduler {
+public:
+	Scheduler();
+	/* Tasks are added highest priority first, with names in flash
+	   from F() so they don't take RAM */
+	void add(const __FlashStringHelper *name, TaskFunc func,
+		 uint16_t period, uint16_t cost, bool background);
+	void setSlack(unsigned int (*slack)()) { m_slack = slack; }
+	void run();		/* Call from loop() */
+	void dump(Print &out);
+	void reset();
+
+private:
+	struct Task {
+		const __FlashStringHelper *name;
+		TaskFunc func;
+		uint16_t period;	/* ms, 0 for every pass */
+		uint16_t cost;		/* us */
+		bool background;
+		unsigned long last;	/* millis() when it last ran */
+		unsigned long runs;
+		unsigned long waits;	/* Passes put off for want of slack */
+		unsigned long total;	/* us */
+		uint16_t worst;		/* us */
+	};
+	Task m_tasks[SCHED_TASKS];
+	uint8_t m_count;
+	unsigned int (*m_slack)();
+};
+
+#endif
@@ -0,0 +1,160 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+
+#include "timeline.h"
+#include <StepTimer.h>
+#include <avr/interrupt.h>
+
+static Timeline *active = 0;
+
+static void motionStopped() {
+	if( active )
+		active->stopped();
+}
+
+Timeline::Timeline(AccelStepper &stepper, uint8_t relayPin) :
+	m_stepper(stepper), m_relayPin(relayPin), m_next(TL_EVENTS),
+	m_aborted(false) {
+	memset(m_planned, 0, sizeof(m_planned));
+	memset((void *)m_measured, 0, sizeof(m_measured));
+}
+
+void Timeline::start(unsigned long preFlow, unsigned long motion, unsigned long postFlow) {
+	uint8_t oldSREG = SREG;
+
+	m_planned[TL_RELAY_ON] = 0;
+	m_planned[TL_MOTION_START] = preFlow;
+	m_planned[TL_MOTION_END] = preFlow + motion;
+	m_planned[TL_RELAY_OFF] = preFlow + motion + postFlow;
+	m_postFlow = postFlow * STEPTIMER_TICKS_PER_US;
+	m_aborted = false;
+	active = this;
+	StepTimer::onStop(motionStopped);
+
+	cli();
+	TCCR1A = 0;		// As StepTimer sets it, so the two can share it
+	TCCR1B = _BV(CS11);
+	m_due = TCNT1;
+	digitalWrite(m_relayPin, HIGH);
+	m_at = 0;
+	m_measured[TL_RELAY_ON] = 0;
+	m_next = TL_MOTION_START;
+	m_target = preFlow * STEPTIMER_TICKS_PER_US;
+	schedule();
+	TIFR1 = _BV(OCF1B);	// Discard any stale compare match
+	TIMSK1 |= _BV(OCIE1B);
+	SREG = oldSREG;
+}
+
+/* Sets the next compare point, at the next event or a chunk on. With
+   interrupts off */
+void Timeline::schedule() {
+	unsigned long left = m_target - m_at;
+	uint16_t chunk = (left > TL_MAX_CHUNK) ? TL_MAX_CHUNK : left;
+
+	m_at += chunk;
+	m_due += chunk;
+	OCR1B = m_due;
+	// Already passed, so it wouldn't match until the timer wraps
+	if( (int16_t)(m_due - TCNT1) <= 0 )
+		OCR1B = TCNT1 + 4;
+}
+
+void Timeline::isr() {
+	// Ticks since the relay came on, from how late we are
+	unsigned long now = m_at + (uint16_t)(TCNT1 - m_due);
+
+	if( m_next == TL_MOTION_END || m_at != m_target ) {
+		// Counting out a long wait, or keeping time until the motor stops
+		if( m_next == TL_MOTION_END )
+			m_target = m_at + TL_MAX_CHUNK;
+		schedule();
+		return;
+	}
+	if( m_next == TL_MOTION_START ) {
+		StepTimer::begin(&m_stepper);
+		m_measured[TL_MOTION_START] = now;
+		m_next = TL_MOTION_END;
+		m_target = m_at + TL_MAX_CHUNK;
+		schedule();
+	}
+	else if( m_next == TL_RELAY_OFF ) {
+		digitalWrite(m_relayPin, LOW);
+		m_measured[TL_RELAY_OFF] = now;
+		m_next = TL_EVENTS;
+		TIMSK1 &= ~_BV(OCIE1B);
+	}
+}
+
+/* From the StepTimer interrupt, as the motor arrives */
+void Timeline::stopped() {
+	unsigned long now;
+
+	if( m_next != TL_MOTION_END )
+		return;
+	// The compare point can be either side of now
+	now = m_at + (int16_t)(TCNT1 - m_due);
+	m_measured[TL_MOTION_END] = now;
+	m_next = TL_RELAY_OFF;
+	// Post flow counts from when it actually stopped
+	m_at = now;
+	m_due = TCNT1;
+	m_target = now + m_postFlow;
+	schedule();
+	// A match of the old compare point would count a chunk of post flow
+	TIFR1 = _BV(OCF1B);
+}
+
+void Timeline::abort() {
+	uint8_t oldSREG = SREG;
+
+	cli();
+	TIMSK1 &= ~_BV(OCIE1B);
+	StepTimer::end();
+	digitalWrite(m_relayPin, LOW);
+	if( m_next < TL_EVENTS ) {
+		// The events that didn't happen are put at the abort
+		m_aborted = true;
+		for( ; m_next < TL_EVENTS; m_next++ )
+			m_measured[m_next] = m_at + (int16_t)(TCNT1 - m_due);
+	}
+	SREG = oldSREG;
+}
+
+uint8_t Timeline::next() {
+	return m_next;
+}
+
+unsigned long Timeline::measured(uint8_t event) {
+	unsigned long ticks;
+	uint8_t oldSREG = SREG;
+
+	cli();
+	ticks = m_measured[event];
+	SREG = oldSREG;
+	return ticks / STEPTIMER_TICKS_PER_US;
+}
+
+long Timeline::late(uint8_t event) {
+	return measured(event) - m_planned[event];
+}
+
+ISR(TIMER1_COMPB_vect) {
+	if( active )
+		active->isr();
+}
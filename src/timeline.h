@@ -0,0 +1,72 @@
+/*
+* Copyright (C) Russell Gower 2014
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+*/
+#ifndef TIMELINE_H
+#define TIMELINE_H
+#include "Arduino.h"
+#include <inttypes.h>
+#include <AccelStepper.h>
+
+/* The events of a run, in order */
+enum { TL_RELAY_ON, TL_MOTION_START, TL_MOTION_END, TL_RELAY_OFF, TL_EVENTS };
+
+/* Longest wait between Timer1 compare B points, in ticks. Half the timer
+   period, so the time can always be read from TCNT1 */
+#define TL_MAX_CHUNK 0x4000
+
+/* Times the events of a run from the Timer1 compare B interrupt, so they
+   don't depend on how often loop() comes round. Timer1 runs as StepTimer
+   sets it up, free running at 2 ticks a us, and StepTimer uses compare A,
+   so the motor can be started from here on the tick it is due. Waits
+   longer than the timer period are counted out in chunks, which also keep
+   the time since the relay came on. The time each event was planned for
+   and the time it happened are kept, so runs can be compared */
+class Timeline {
+public:
+	Timeline(AccelStepper &stepper, uint8_t relayPin);
+	/* Turns the relay on now, starts stepping preFlow us later, and turns
+	   the relay off postFlow us after the motor stops. Set the stepper's
+	   speed and target first. motion is how long the move should take,
+	   for the plan. Nothing else may use Timer1 compare B after */
+	void start(unsigned long preFlow, unsigned long motion, unsigned long postFlow);
+	void abort();			/* Stops the motor and turns the relay off */
+	uint8_t next();			/* The next event, TL_EVENTS when done */
+	bool running() { return next() < TL_EVENTS; }
+	unsigned long planned(uint8_t event) { return m_planned[event]; }
+	unsigned long measured(uint8_t event);	/* us after the relay came on */
+	long late(uint8_t event);	/* Measured less planned, us */
+	bool aborted() { return m_aborted; }
+
+	void isr();			/* Internal use only */
+	void stopped();
+
+private:
+	void schedule();
+
+	AccelStepper &m_stepper;
+	uint8_t m_relayPin;
+	unsigned long m_planned[TL_EVENTS];	/* us */
+	volatile unsigned long m_measured[TL_EVENTS];	/* Ticks */
+	volatile uint8_t m_next;
+	bool m_aborted;
+	unsigned long m_postFlow;	/* Ticks */
+	unsigned long m_target;		/* Ticks to the next event */
+	unsigned long m_at;		/* Ticks to the compare point in OCR1B */
+	uint16_t m_due;			/* Where the compare point should be */
+};
+
+#endif